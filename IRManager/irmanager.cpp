@@ -55,11 +55,11 @@ namespace ir_manager {
             if (!function_target->hasExactDefinition())
                 return ERR::FUNCTION_NOT_DEFINED;
 
-            IRBuilder<>* builder = new IRBuilder<>(block_detour);
+            IRBuilder<> builder(block_detour);
 
             BasicBlock& bl_entry = function_target->getEntryBlock();
 
-            builder->CreateBr(&bl_entry);
+            builder.CreateBr(&bl_entry);
 
             block_detour->insertInto(function_target, &bl_entry);
 
@@ -88,9 +88,9 @@ namespace ir_manager {
 
             vec_bl_fn.erase(std::remove_if(vec_bl_fn.begin(), vec_bl_fn.end(), [](BasicBlock* const& bl) {
 
-                size_t n_ins = 0; // number of instructions in basic block
+                size_t n_ins = 0; // number of instructions in basic block, PHIs and EH pads can't be split apart
 
-                auto it_ins = bl->begin();
+                auto it_ins = bl->getFirstInsertionPt();
                 for (; it_ins != bl->end(); it_ins++)
                     n_ins++;
 
@@ -110,14 +110,14 @@ namespace ir_manager {
 
                 size_t n_ins = 0;
 
-                auto it_ins = bl->begin();
+                auto it_ins = bl->getFirstInsertionPt();
                 for (; it_ins != bl->end(); it_ins++)
                     n_ins++;
 
                 size_t n_spl = 0;
                 do {
 
-                    it_ins = bl->begin();
+                    it_ins = bl->getFirstInsertionPt();
 
                     size_t split_at = generate_random_integer<size_t>(
                         1,
@@ -0,0 +1,273 @@
+/*
+	Microbenchmarks for math::generate_equation and opaque::opaque_by_user_shared_data.
+
+	Measures equations (or opaque values) per second and heap allocations per equation across
+	integer widths and deepnesses. Each emitted chain is also evaluated by constant folding, with
+	opaque loads replaced by their runtime value, and compared against the value the equation claims.
+*/
+
+#include "include/obfmath.hpp"
+#include "include/opaque.hpp"
+
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include "benchmark/benchmark.h"
+
+#include <atomic>
+#include <cstdlib>
+
+
+using namespace llvm;
+
+
+static std::atomic<size_t> n_allocs{ 0 };
+
+void* operator new(size_t sz) {
+
+	n_allocs.fetch_add(1, std::memory_order_relaxed);
+
+	void* ptr = std::malloc(sz ? sz : 1);
+
+	if (!ptr) report_bad_alloc_error("Allocation failed on equation benchmark.");
+
+	return ptr;
+
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+
+namespace {
+
+	/* Opaque values never pass a non-zero byte through, so every opaque load evaluates to zero */
+	Constant* evaluate_chain(const std::vector<Value*>& insts, const DataLayout& dl) {
+
+		Value* v_last = nullptr;
+
+		for (Value* val : insts) {
+
+			Instruction* inst = cast<Instruction>(val);
+
+			Constant* c_folded = isa<LoadInst>(inst)
+				? Constant::getNullValue(inst->getType())
+				: ConstantFoldInstruction(inst, dl);
+
+			if (!c_folded) return nullptr; // an operand isn't known, chain is broken
+
+			inst->replaceAllUsesWith(c_folded);
+
+			v_last = c_folded;
+
+		}
+
+		return dyn_cast_or_null<Constant>(v_last);
+
+	}
+
+	void delete_chain(const std::vector<Value*>& insts) {
+
+		for (Value* val : insts)
+			cast<Instruction>(val)->dropAllReferences();
+
+		for (Value* val : insts)
+			val->deleteValue();
+
+	}
+
+	template <typename T>
+	std::vector<math::insval_t> create_opaque_vals(emit::context& ectx, size_t n_vals) {
+
+		std::vector<math::insval_t> opaque_vals = {};
+
+		for (size_t i = 0; i < n_vals; ++i) {
+
+			T val_opaque = static_cast<T>(0x9E3779B97F4A7C15ull * (i + 1));
+
+			auto insts_opaque = opaque::opaque_by_user_shared_data(ectx, val_opaque, sizeof(T) * 8);
+
+			opaque_vals.push_back({ std::vector<Value*>(insts_opaque.begin(), insts_opaque.end()), val_opaque });
+
+		}
+
+		return opaque_vals;
+
+	}
+
+	template <typename T>
+	void BM_GenerateEquation(benchmark::State& state) {
+
+		LLVMContext ctx;
+		Module mod("ux-equation-bench", ctx);
+		emit::context ectx(mod);
+
+		size_t num_deepness = static_cast<size_t>(state.range(0));
+
+		size_t n_allocs_total = 0;
+		size_t n_mismatches = 0;
+		size_t n_insts_total = 0;
+
+		for (auto _ : state) {
+
+			state.PauseTiming();
+
+			auto opaque_vals = create_opaque_vals<T>(ectx, 3);
+
+			size_t n_allocs_start = n_allocs.load(std::memory_order_relaxed);
+
+			state.ResumeTiming();
+
+			math::insval_t insval_eq = math::generate_equation<T>(ectx, opaque_vals, num_deepness);
+
+			state.PauseTiming();
+
+			n_allocs_total += n_allocs.load(std::memory_order_relaxed) - n_allocs_start;
+			n_insts_total += insval_eq.first.size();
+
+			ConstantInt* c_eq = dyn_cast_or_null<ConstantInt>(evaluate_chain(insval_eq.first, mod.getDataLayout()));
+
+			if (!c_eq || c_eq->getZExtValue() != static_cast<T>(insval_eq.second))
+				n_mismatches++;
+
+			delete_chain(insval_eq.first);
+
+			state.ResumeTiming();
+
+		}
+
+		state.counters["equations/s"] = benchmark::Counter(
+			static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+		state.counters["allocs/equation"] = benchmark::Counter(
+			static_cast<double>(n_allocs_total), benchmark::Counter::kAvgIterations);
+		state.counters["insts/equation"] = benchmark::Counter(
+			static_cast<double>(n_insts_total), benchmark::Counter::kAvgIterations);
+		state.counters["mismatches"] = static_cast<double>(n_mismatches);
+
+		if (n_mismatches)
+			state.SkipWithError("Emitted equation chains don't evaluate to their claimed values.");
+
+	}
+
+	template <typename T>
+	void BM_GenerateEquationRoots(benchmark::State& state) {
+
+		LLVMContext ctx;
+		Module mod("ux-equation-bench", ctx);
+		emit::context ectx(mod);
+
+		size_t num_deepness = static_cast<size_t>(state.range(0));
+		size_t num_roots = static_cast<size_t>(state.range(1));
+
+		size_t n_mismatches = 0;
+		size_t n_insts_total = 0;
+
+		std::vector<math::insval_t> roots = {};
+
+		for (auto _ : state) {
+
+			state.PauseTiming();
+
+			auto opaque_vals = create_opaque_vals<T>(ectx, 3);
+
+			state.ResumeTiming();
+
+			std::vector<Value*> insts_eq = math::generate_equation_roots<T>(ectx, opaque_vals, num_deepness, num_roots, roots);
+
+			state.PauseTiming();
+
+			evaluate_chain(insts_eq, mod.getDataLayout()); // roots read the folded nodes of the DAG
+
+			for (auto& root : roots) {
+
+				ConstantInt* c_root = dyn_cast_or_null<ConstantInt>(evaluate_chain(root.first, mod.getDataLayout()));
+
+				if (!c_root || c_root->getZExtValue() != static_cast<T>(root.second))
+					n_mismatches++;
+
+				insts_eq.insert(insts_eq.end(), root.first.begin(), root.first.end());
+
+			}
+
+			n_insts_total += insts_eq.size();
+
+			delete_chain(insts_eq);
+
+			state.ResumeTiming();
+
+		}
+
+		state.counters["roots/s"] = benchmark::Counter(
+			static_cast<double>(state.iterations() * num_roots), benchmark::Counter::kIsRate);
+		state.counters["insts/root"] = benchmark::Counter(
+			static_cast<double>(n_insts_total) / num_roots, benchmark::Counter::kAvgIterations);
+		state.counters["mismatches"] = static_cast<double>(n_mismatches);
+
+		if (n_mismatches)
+			state.SkipWithError("Roots of the emitted equation don't evaluate to their claimed values.");
+
+	}
+
+	template <typename T>
+	void BM_OpaqueValue(benchmark::State& state) {
+
+		LLVMContext ctx;
+		Module mod("ux-opaque-bench", ctx);
+		emit::context ectx(mod);
+
+		size_t n_allocs_total = 0;
+		size_t n_mismatches = 0;
+
+		for (auto _ : state) {
+
+			size_t n_allocs_start = n_allocs.load(std::memory_order_relaxed);
+
+			auto insts_opaque = opaque::opaque_by_user_shared_data(ectx, 0xA5A5A5A5A5A5A5A5ull, sizeof(T) * 8);
+
+			state.PauseTiming();
+
+			n_allocs_total += n_allocs.load(std::memory_order_relaxed) - n_allocs_start;
+
+			std::vector<Value*> vals_opaque(insts_opaque.begin(), insts_opaque.end());
+
+			ConstantInt* c_opaque = dyn_cast_or_null<ConstantInt>(evaluate_chain(vals_opaque, mod.getDataLayout()));
+
+			if (!c_opaque || c_opaque->getZExtValue() != static_cast<T>(0xA5A5A5A5A5A5A5A5ull))
+				n_mismatches++;
+
+			delete_chain(vals_opaque);
+
+			state.ResumeTiming();
+
+		}
+
+		state.counters["values/s"] = benchmark::Counter(
+			static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+		state.counters["allocs/value"] = benchmark::Counter(
+			static_cast<double>(n_allocs_total), benchmark::Counter::kAvgIterations);
+		state.counters["mismatches"] = static_cast<double>(n_mismatches);
+
+		if (n_mismatches)
+			state.SkipWithError("Emitted opaque values don't evaluate to their claimed values.");
+
+	}
+
+}
+
+BENCHMARK_TEMPLATE(BM_GenerateEquation, uint8_t)->Arg(5)->Arg(30)->Arg(100);
+BENCHMARK_TEMPLATE(BM_GenerateEquation, uint16_t)->Arg(5)->Arg(30)->Arg(100);
+BENCHMARK_TEMPLATE(BM_GenerateEquation, uint32_t)->Arg(5)->Arg(30)->Arg(100);
+BENCHMARK_TEMPLATE(BM_GenerateEquation, uint64_t)->Arg(5)->Arg(30)->Arg(100);
+
+// Instructions per root should drop as the roots share one DAG
+BENCHMARK_TEMPLATE(BM_GenerateEquationRoots, uint64_t)->Args({ 30, 1 })->Args({ 30, 16 })->Args({ 30, 128 });
+
+BENCHMARK_TEMPLATE(BM_OpaqueValue, uint8_t);
+BENCHMARK_TEMPLATE(BM_OpaqueValue, uint16_t);
+BENCHMARK_TEMPLATE(BM_OpaqueValue, uint32_t);
+BENCHMARK_TEMPLATE(BM_OpaqueValue, uint64_t);
+
+BENCHMARK_MAIN();
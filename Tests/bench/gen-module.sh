@@ -0,0 +1,105 @@
+#!/bin/bash
+
+# Generates a synthetic IR module to benchmark obfuscation passes on.
+# Every function obfuscates its own string literals through _obf_str, reads and writes
+# globals (for reference obfuscation) and has a straight block of arithmetic (for splitting).
+
+if [ $# -lt 5 ]; then
+
+	echo "Usage: "$0" <functions> <strings per function> <string length> <globals> <block size>"
+
+	exit 1
+
+fi
+
+NFUNCTIONS=$1
+NSTRINGS=$2
+SZSTRING=$3
+NGLOBALS=$4
+SZBLOCK=$5
+
+if [ $SZSTRING -lt 1 ] || [ $NGLOBALS -lt 1 ] || [ $SZBLOCK -lt 1 ]; then
+
+	echo "String length, globals and block size must be at least 1."
+
+	exit 1
+
+fi
+
+# Literal content is the same for all strings, only its length matters for the passes
+STRCONTENT=$(head -c $(($SZSTRING - 1)) < /dev/zero | tr '\0' 'x')
+
+echo 'source_filename = "ux-synthetic"'
+echo 'target datalayout = "e-m:w-p270:32:32-p271:32:32-p272:64:64-i64:64-i128:128-f80:128-n8:16:32:64-S128"'
+echo 'target triple = "x86_64-pc-windows-msvc"'
+echo
+
+for ((g = 0; g < NGLOBALS; g++)); do
+
+	echo "@g.$g = internal global i64 $g, align 8"
+
+done
+
+for ((f = 0; f < NFUNCTIONS; f++)); do
+
+	for ((s = 0; s < NSTRINGS; s++)); do
+
+		echo "@.str.$f.$s = private unnamed_addr constant [$SZSTRING x i8] c\"$STRCONTENT\\00\", align 1"
+
+	done
+
+done
+
+echo
+echo 'define internal ptr @_obf_str(ptr %0) #0 section "._obf_str" {'
+echo '  ret ptr %0'
+echo '}'
+echo
+echo 'declare void @sink(ptr)'
+echo
+
+for ((f = 0; f < NFUNCTIONS; f++)); do
+
+	echo "define i64 @fn.$f(i64 %a) {"
+	echo "entry:"
+
+	for ((s = 0; s < NSTRINGS; s++)); do
+
+		echo "  %s.$s = call ptr @_obf_str(ptr @.str.$f.$s)"
+		echo "  call void @sink(ptr %s.$s)"
+
+	done
+
+	# Each function touches four globals, rotating over all of them
+	for ((k = 0; k < 4; k++)); do
+
+		g=$(( (f * 4 + k) % NGLOBALS ))
+
+		echo "  %l.$k = load i64, ptr @g.$g, align 8"
+		echo "  %n.$k = add i64 %l.$k, %a"
+		echo "  store i64 %n.$k, ptr @g.$g, align 8"
+
+	done
+
+	echo "  %v.0 = add i64 %a, %n.0"
+
+	for ((i = 1; i < SZBLOCK; i++)); do
+
+		case $((i % 4)) in
+			0) echo "  %v.$i = add i64 %v.$((i - 1)), $i" ;;
+			1) echo "  %v.$i = xor i64 %v.$((i - 1)), %a" ;;
+			2) echo "  %v.$i = mul i64 %v.$((i - 1)), 3" ;;
+			3) echo "  %v.$i = sub i64 %v.$((i - 1)), %n.$((i % 4))" ;;
+		esac
+
+	done
+
+	echo "  ret i64 %v.$((SZBLOCK - 1))"
+	echo "}"
+	echo
+
+done
+
+echo 'attributes #0 = { noinline }'
+
+exit 0
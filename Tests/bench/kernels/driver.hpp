@@ -0,0 +1,32 @@
+#ifndef WAREVISOR_BENCH_DRIVER
+#define WAREVISOR_BENCH_DRIVER
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+#include "../../include/defs.hpp"
+
+/* Implemented by each kernel, returns a checksum so the work can't be optimized away */
+uint64_t run_kernel(uint64_t iterations);
+
+/* Kernels run for 'iterations' given as first argument. Elapsed TSC cycles are printed to stderr,
+	so the harness can fall back to them when perf counters are not available */
+int main(int argc, char** argv) {
+
+	uint64_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+
+	uint64_t tsc_start = __rdtsc();
+
+	uint64_t checksum = run_kernel(iterations);
+
+	uint64_t tsc_end = __rdtsc();
+
+	printf("checksum=%llu\n", (unsigned long long)checksum);
+	fprintf(stderr, "tsc_cycles=%llu\n", (unsigned long long)(tsc_end - tsc_start));
+
+	return 0;
+
+}
+
+#endif
@@ -0,0 +1,26 @@
+#include "driver.hpp"
+
+/* Tight loops over globals: counters and accumulators living in module scope */
+
+static uint64_t counter_a = 1;
+static uint64_t counter_b = 2;
+static uint32_t weights[64];
+
+__attribute__((noinline)) static void step(uint64_t i) {
+
+	counter_a += weights[i & 63];
+	counter_b ^= counter_a + i;
+
+}
+
+uint64_t run_kernel(uint64_t iterations) {
+
+	for (uint32_t i = 0; i < 64; ++i)
+		weights[i] = i * i + 1;
+
+	for (uint64_t i = 0; i < iterations * 16; ++i)
+		step(i);
+
+	return counter_a + counter_b;
+
+}
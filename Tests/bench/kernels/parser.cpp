@@ -0,0 +1,89 @@
+#include "driver.hpp"
+
+/* Branchy parser: tokenizes an input of identifiers, numbers and operators */
+
+static char input_buf[8192];
+
+static void init_input() {
+
+	static const char pieces[][8] = { "alpha", "42", "+", "beta_7", "(", "1000", ")", "*", " ", "x", "\n", "-9" };
+
+	size_t pos = 0;
+
+	for (uint32_t i = 0; pos + 8 < sizeof(input_buf); ++i) {
+
+		const char* piece = pieces[(i * 7 + (i >> 3)) % 12];
+
+		while (*piece) input_buf[pos++] = *piece++;
+
+	}
+
+	input_buf[pos] = '\0';
+
+}
+
+static uint64_t parse(const char* text) {
+
+	uint64_t n_tokens = 0, sum_numbers = 0;
+
+	while (*text) {
+
+		char c = *text;
+
+		if (c == ' ' || c == '\n' || c == '\t') {
+
+			++text;
+
+		} else if (c >= '0' && c <= '9') {
+
+			uint64_t number = 0;
+
+			while (*text >= '0' && *text <= '9') number = number * 10 + (*text++ - '0');
+
+			sum_numbers += number;
+			++n_tokens;
+
+		} else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+
+			while ((*text >= 'a' && *text <= 'z') || (*text >= 'A' && *text <= 'Z')
+				|| (*text >= '0' && *text <= '9') || *text == '_') ++text;
+
+			++n_tokens;
+
+		} else {
+
+			switch (c) {
+				case '+': case '-': case '*': case '/': case '(': case ')':
+					++n_tokens;
+					break;
+				default:
+					break;
+			}
+
+			++text;
+
+		}
+
+	}
+
+	return n_tokens * 1000003 + sum_numbers;
+
+}
+
+uint64_t run_kernel(uint64_t iterations) {
+
+	init_input();
+
+	uint64_t checksum = 0;
+
+	for (uint64_t i = 0; i < iterations / 256 + 1; ++i) {
+
+		input_buf[i % 64] = (char)('a' + i % 26);
+
+		checksum += parse(input_buf);
+
+	}
+
+	return checksum;
+
+}
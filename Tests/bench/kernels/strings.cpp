@@ -0,0 +1,26 @@
+#include <string.h>
+#include "driver.hpp"
+
+/* String-heavy logging: every event formats a line with obfuscated literals */
+
+static char log_buf[256];
+
+__attribute__((noinline)) static size_t log_event(uint64_t id, uint64_t value) {
+
+	const char* level = (id & 7) == 0 ? OBFUSCATE("warning") : OBFUSCATE("info");
+
+	return snprintf(log_buf, sizeof(log_buf), OBFUSCATE("[%s] event %llu: value=%llu (%s)"),
+		level, (unsigned long long)id, (unsigned long long)value, OBFUSCATE("subsystem/network/session"));
+
+}
+
+uint64_t run_kernel(uint64_t iterations) {
+
+	uint64_t checksum = 0;
+
+	for (uint64_t i = 0; i < iterations; ++i)
+		checksum += log_event(i, i * 2654435761u) + (uint8_t)log_buf[3];
+
+	return checksum;
+
+}
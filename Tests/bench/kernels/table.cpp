@@ -0,0 +1,45 @@
+#include "driver.hpp"
+
+/* Global-table lookups: CRC32 over a buffer through a 256 entry table */
+
+static uint32_t crc_table[256];
+static uint8_t data_buf[4096];
+
+static void init_tables() {
+
+	for (uint32_t i = 0; i < 256; ++i) {
+
+		uint32_t c = i;
+
+		for (int k = 0; k < 8; ++k)
+			c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+
+		crc_table[i] = c;
+
+	}
+
+	for (uint32_t i = 0; i < sizeof(data_buf); ++i)
+		data_buf[i] = (uint8_t)(i * 31 + 7);
+
+}
+
+uint64_t run_kernel(uint64_t iterations) {
+
+	init_tables();
+
+	uint64_t checksum = 0;
+
+	for (uint64_t i = 0; i < iterations / 64 + 1; ++i) {
+
+		uint32_t crc = 0xFFFFFFFFu ^ (uint32_t)i;
+
+		for (uint32_t j = 0; j < sizeof(data_buf); ++j)
+			crc = crc_table[(crc ^ data_buf[j]) & 0xFF] ^ (crc >> 8);
+
+		checksum += crc ^ 0xFFFFFFFFu;
+
+	}
+
+	return checksum;
+
+}
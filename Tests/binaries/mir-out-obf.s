@@ -1,120 +0,0 @@
-	.text
-	.file	"main.cpp"
-	.globl	_Z11str_printerv                # -- Begin function _Z11str_printerv
-	.p2align	4, 0x90
-	.type	_Z11str_printerv,@function
-_Z11str_printerv:                       # @_Z11str_printerv
-	.cfi_startproc
-# %bb.0:
-	pushq	%rbp
-	.cfi_def_cfa_offset 16
-	.cfi_offset %rbp, -16
-	movq	%rsp, %rbp
-	.cfi_def_cfa_register %rbp
-	movabsq	$.L.str, %rdi
-	movb	$0, %al
-	callq	printf@PLT
-	movabsq	$.L.str.1, %rdi
-	callq	_ZL8_obf_strPKc
-	popq	%rbp
-	.cfi_def_cfa %rsp, 8
-	retq
-.Lfunc_end0:
-	.size	_Z11str_printerv, .Lfunc_end0-_Z11str_printerv
-	.cfi_endproc
-                                        # -- End function
-	.section	._obf_str,"ax",@progbits
-	.p2align	4, 0x90                         # -- Begin function _ZL8_obf_strPKc
-	.type	_ZL8_obf_strPKc,@function
-_ZL8_obf_strPKc:                        # @_ZL8_obf_strPKc
-	.cfi_startproc
-# %bb.0:
-	pushq	%rbp
-	.cfi_def_cfa_offset 16
-	.cfi_offset %rbp, -16
-	movq	%rsp, %rbp
-	.cfi_def_cfa_register %rbp
-	movq	%rdi, -8(%rbp)
-	movq	-8(%rbp), %rax
-	popq	%rbp
-	.cfi_def_cfa %rsp, 8
-	retq
-.Lfunc_end1:
-	.size	_ZL8_obf_strPKc, .Lfunc_end1-_ZL8_obf_strPKc
-	.cfi_endproc
-                                        # -- End function
-	.text
-	.globl	main                            # -- Begin function main
-	.p2align	4, 0x90
-	.type	main,@function
-main:                                   # @main
-	.cfi_startproc
-# %bb.0:
-	pushq	%rbp
-	.cfi_def_cfa_offset 16
-	.cfi_offset %rbp, -16
-	movq	%rsp, %rbp
-	.cfi_def_cfa_register %rbp
-	subq	$48, %rsp
-	movl	$300, -48(%rbp)                 # imm = 0x12C
-	movabsq	$.L.str.2, %rdi
-	callq	_ZL8_obf_strPKc
-	movq	%rax, -40(%rbp)
-	movl	$90000, -32(%rbp)               # imm = 0x15F90
-	movabsq	$.L.str.3, %rdi
-	callq	_ZL8_obf_strPKc
-	movq	%rax, -24(%rbp)
-	movq	-40(%rbp), %rax
-	movq	%rax, -16(%rbp)
-	movq	-24(%rbp), %rax
-	movq	%rax, -8(%rbp)
-	movq	-16(%rbp), %rsi
-	movabsq	$.L.str.4, %rdi
-	movb	$0, %al
-	callq	printf@PLT
-	movq	-8(%rbp), %rsi
-	movabsq	$.L.str.4, %rdi
-	movb	$0, %al
-	callq	printf@PLT
-	callq	_Z11str_printerv
-	movabsq	$.L.str.4, %rdi
-	movq	%rax, %rsi
-	movb	$0, %al
-	callq	printf@PLT
-	xorl	%eax, %eax
-	addq	$48, %rsp
-	popq	%rbp
-	.cfi_def_cfa %rsp, 8
-	retq
-.Lfunc_end2:
-	.size	main, .Lfunc_end2-main
-	.cfi_endproc
-                                        # -- End function
-	.type	.L.str,@object                  # @.str
-	.section	.rodata.str1.1,"aMS",@progbits,1
-.L.str:
-	.asciz	"Gonna let str_printer talk!\n"
-	.size	.L.str, 29
-
-	.type	.L.str.1,@object                # @.str.1
-.L.str.1:
-	.asciz	"str_printer: hello world!"
-	.size	.L.str.1, 26
-
-	.type	.L.str.2,@object                # @.str.2
-.L.str.2:
-	.asciz	"warevisor"
-	.size	.L.str.2, 10
-
-	.type	.L.str.3,@object                # @.str.3
-.L.str.3:
-	.asciz	"warevising"
-	.size	.L.str.3, 11
-
-	.type	.L.str.4,@object                # @.str.4
-.L.str.4:
-	.asciz	"%s\n"
-	.size	.L.str.4, 4
-
-	.ident	"Ubuntu clang version 18.1.3 (1ubuntu1)"
-	.section	".note.GNU-stack","",@progbits
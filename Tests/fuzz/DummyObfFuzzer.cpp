@@ -0,0 +1,17 @@
+/*
+	Runs the differential fuzzer on the given inputs when it isn't built with libFuzzer.
+
+		UX-Obfuscator-Fuzzer input_1 input_2 ... -ignore_remaining_args=1 -ux-fuzz-max-slowdown=50
+*/
+
+#include "llvm/FuzzMutate/FuzzerCLI.h"
+
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+int main(int argc, char* argv[]) {
+
+	return llvm::runFuzzerOnInputs(argc, argv, LLVMFuzzerTestOneInput, LLVMFuzzerInitialize);
+
+}
@@ -0,0 +1,479 @@
+/*
+	Differential fuzzer for the obfuscation transforms.
+
+	Every input is turned into a module with string literals passed through _obf_str and
+	loads/stores of integer globals. A copy of the module is obfuscated (pool, mba, consts, strings, refs, split, bcf, cleanup),
+	both versions are executed in ORC LLJIT (Linux, so opaque values are read from '__ux_opaque_src')
+	and the results of every call are compared. Broken IR, a mismatch or a runtime slowdown beyond
+	'-ux-fuzz-max-slowdown' aborts, which libFuzzer (or the dummy driver) reports as a failure.
+	Max and mean slowdown of the timed inputs are printed on exit.
+
+	Options are given after '-ignore_remaining_args=1':
+
+		UX-Obfuscator-Fuzzer corpus/ -ignore_remaining_args=1 -ux-fuzz-max-slowdown=50
+*/
+
+#include "include/selection.hpp"
+#include "include/transforms.hpp"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/FuzzMutate/FuzzerCLI.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <chrono>
+#include <cstdlib>
+
+
+using namespace llvm;
+
+
+static cl::opt<double> MaxSlowdown(
+	"ux-fuzz-max-slowdown",
+	cl::desc("Fail when the obfuscated module runs this many times slower than the original"),
+	cl::init(100.0));
+
+static cl::opt<unsigned> NumRuns(
+	"ux-fuzz-runs",
+	cl::desc("How many times the entry of each module is called"),
+	cl::init(64));
+
+static cl::opt<double> MinTimedUs(
+	"ux-fuzz-min-timed-us",
+	cl::desc("Slowdown is only checked when the original module runs at least this long (microseconds)"),
+	cl::init(20.0));
+
+
+namespace {
+
+	constexpr const char* ENTRY_NAME = "ux_fuzz_entry";
+
+	typedef uint64_t (*entry_fn_t)();
+
+	/* Consumes the fuzzer input, yields zeros once exhausted */
+	struct byte_reader {
+
+		const uint8_t* data;
+		size_t size;
+
+		uint8_t next() {
+
+			if (!size) return 0;
+
+			size--;
+
+			return *data++;
+
+		}
+
+		uint64_t next_u64() {
+
+			uint64_t val = 0;
+
+			for (size_t i = 0; i < 8; ++i)
+				val = (val << 8) | next();
+
+			return val;
+
+		}
+
+		uint8_t next_in(uint8_t n_range) { return next() % n_range; }
+
+	};
+
+	/* i64 hash(ptr str), folds every byte of a null terminated string */
+	Function* create_hash_function(Module& mod) {
+
+		LLVMContext& ctx = mod.getContext();
+
+		Type* ty_i8 = Type::getInt8Ty(ctx);
+		Type* ty_i64 = Type::getInt64Ty(ctx);
+		Type* ty_ptr = ty_i8->getPointerTo();
+
+		Function* fn_hash = Function::Create(
+			FunctionType::get(ty_i64, { ty_ptr }, false), GlobalValue::InternalLinkage, "ux_fuzz_hash", mod);
+
+		fn_hash->addFnAttr(Attribute::NoInline);
+
+		BasicBlock* bl_entry = BasicBlock::Create(ctx, "entry", fn_hash);
+		BasicBlock* bl_loop = BasicBlock::Create(ctx, "loop", fn_hash);
+		BasicBlock* bl_exit = BasicBlock::Create(ctx, "exit", fn_hash);
+
+		IRBuilder<> builder(bl_entry);
+		builder.CreateBr(bl_loop);
+
+		builder.SetInsertPoint(bl_loop);
+
+		PHINode* phi_idx = builder.CreatePHI(ty_i64, 2);
+		PHINode* phi_hash = builder.CreatePHI(ty_i64, 2);
+
+		Value* v_byte = builder.CreateLoad(ty_i8, builder.CreateGEP(ty_i8, fn_hash->getArg(0), phi_idx));
+		Value* v_hash = builder.CreateAdd(
+			builder.CreateMul(phi_hash, builder.getInt64(0x100000001B3)), builder.CreateZExt(v_byte, ty_i64));
+		Value* v_idx = builder.CreateAdd(phi_idx, builder.getInt64(1));
+
+		phi_idx->addIncoming(builder.getInt64(0), bl_entry);
+		phi_idx->addIncoming(v_idx, bl_loop);
+		phi_hash->addIncoming(builder.getInt64(0xCBF29CE484222325), bl_entry);
+		phi_hash->addIncoming(v_hash, bl_loop);
+
+		builder.CreateCondBr(builder.CreateICmpEQ(v_byte, builder.getInt8(0)), bl_exit, bl_loop);
+
+		builder.SetInsertPoint(bl_exit);
+		builder.CreateRet(phi_hash);
+
+		return fn_hash;
+
+	}
+
+	/* Same shape as OBFUSCATE of Tests/include/defs.hpp */
+	Function* create_obf_str_function(Module& mod) {
+
+		LLVMContext& ctx = mod.getContext();
+
+		Type* ty_ptr = Type::getInt8Ty(ctx)->getPointerTo();
+
+		Function* fn_obf_str = Function::Create(
+			FunctionType::get(ty_ptr, { ty_ptr }, false), GlobalValue::InternalLinkage, "_obf_str", mod);
+
+		fn_obf_str->setSection("._obf_str");
+		fn_obf_str->addFnAttr(Attribute::NoInline);
+
+		IRBuilder<> builder(BasicBlock::Create(ctx, "entry", fn_obf_str));
+		builder.CreateRet(fn_obf_str->getArg(0));
+
+		return fn_obf_str;
+
+	}
+
+	/*
+	Builds 'i64 ux_fuzz_entry()' from the input: up to 8 string literals, 8 integer globals, a
+	16 element array and a read-only internal table (moved into the encrypted pool), mixed into
+	an accumulator by a sequence of up to 48 operations.
+	Globals are written too, so each call of the entry returns a different value.
+	*/
+	std::unique_ptr<Module> create_fuzz_module(LLVMContext& ctx, byte_reader& reader, const orc::LLJIT& jit) {
+
+		auto mod = std::make_unique<Module>("ux-fuzz", ctx);
+
+		mod->setTargetTriple(jit.getTargetTriple().str());
+		mod->setDataLayout(jit.getDataLayout());
+
+		Type* ty_i32 = Type::getInt32Ty(ctx);
+		Type* ty_i64 = Type::getInt64Ty(ctx);
+
+		Function* fn_hash = create_hash_function(*mod);
+		Function* fn_obf_str = create_obf_str_function(*mod);
+
+		std::vector<GlobalVariable*> g_strs = {};
+
+		for (size_t i = 0, n_strs = reader.next_in(8) + 1; i < n_strs; ++i) {
+
+			std::string str(reader.next_in(64) + 1, '\0');
+
+			for (char& chr : str)
+				chr = static_cast<char>(reader.next() | 1); // literals can't end early
+
+			Constant* c_str = ConstantDataArray::getString(ctx, str);
+
+			GlobalVariable* g_str = new GlobalVariable(
+				*mod, c_str->getType(), true, GlobalValue::PrivateLinkage, c_str, ".str");
+
+			g_str->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+
+			g_strs.push_back(g_str);
+
+		}
+
+		std::vector<GlobalVariable*> g_ints = {};
+
+		for (size_t i = 0, n_ints = reader.next_in(8) + 1; i < n_ints; ++i) {
+
+			IntegerType* ty_int = reader.next() & 1 ? IntegerType::get(ctx, 64) : IntegerType::get(ctx, 32);
+
+			g_ints.push_back(new GlobalVariable(
+				*mod, ty_int, false, GlobalValue::InternalLinkage, ConstantInt::get(ty_int, reader.next_u64()), "g"));
+
+		}
+
+		ArrayType* ty_arr = ArrayType::get(ty_i32, 16);
+
+		std::vector<Constant*> c_elems = {};
+
+		for (size_t i = 0; i < 16; ++i)
+			c_elems.push_back(ConstantInt::get(ty_i32, reader.next_u64()));
+
+		GlobalVariable* g_arr = new GlobalVariable(
+			*mod, ty_arr, false, GlobalValue::InternalLinkage, ConstantArray::get(ty_arr, c_elems), "arr");
+
+		// Constant table of 1-16 words, read only, so ux-pool takes it
+		ArrayType* ty_tbl = ArrayType::get(ty_i64, reader.next_in(16) + 1);
+
+		std::vector<Constant*> c_words = {};
+
+		for (size_t i = 0; i < ty_tbl->getNumElements(); ++i)
+			c_words.push_back(ConstantInt::get(ty_i64, reader.next_u64()));
+
+		GlobalVariable* g_tbl = new GlobalVariable(
+			*mod, ty_tbl, true, GlobalValue::InternalLinkage, ConstantArray::get(ty_tbl, c_words), "tbl");
+
+		Function* fn_entry = Function::Create(
+			FunctionType::get(ty_i64, false), GlobalValue::ExternalLinkage, ENTRY_NAME, *mod);
+
+		IRBuilder<> builder(BasicBlock::Create(ctx, "entry", fn_entry));
+
+		Value* v_acc = builder.getInt64(reader.next_u64());
+
+		for (size_t i = 0, n_ops = reader.next_in(48) + 1; i < n_ops; ++i) {
+
+			switch (reader.next_in(6)) {
+
+				case 0: { // acc ^= hash(_obf_str(str))
+
+					GlobalVariable* g_str = g_strs[reader.next_in(g_strs.size())];
+
+					Value* v_str = builder.CreateCall(fn_obf_str, { builder.CreateConstGEP2_64(g_str->getValueType(), g_str, 0, 0) });
+
+					v_acc = builder.CreateXor(v_acc, builder.CreateCall(fn_hash, { v_str }));
+
+					break;
+
+				}
+
+				case 1: { // acc += g
+
+					GlobalVariable* g_int = g_ints[reader.next_in(g_ints.size())];
+
+					v_acc = builder.CreateAdd(v_acc, builder.CreateZExt(builder.CreateLoad(g_int->getValueType(), g_int), ty_i64));
+
+					break;
+
+				}
+
+				case 2: { // g = acc
+
+					GlobalVariable* g_int = g_ints[reader.next_in(g_ints.size())];
+
+					builder.CreateStore(builder.CreateTrunc(v_acc, g_int->getValueType()), g_int);
+
+					break;
+
+				}
+
+				case 3: { // acc = acc * k + arr[idx]
+
+					Value* v_elem = builder.CreateLoad(ty_i32, builder.CreateConstGEP2_64(ty_arr, g_arr, 0, reader.next_in(16)));
+
+					v_acc = builder.CreateAdd(builder.CreateMul(v_acc, builder.getInt64(reader.next_u64() | 1)), builder.CreateZExt(v_elem, ty_i64));
+
+					break;
+
+				}
+
+				case 4: { // arr[idx] = acc
+
+					builder.CreateStore(builder.CreateTrunc(v_acc, ty_i32), builder.CreateConstGEP2_64(ty_arr, g_arr, 0, reader.next_in(16)));
+
+					break;
+
+				}
+
+				case 5: { // acc ^= tbl[idx]
+
+					uint64_t idx = reader.next_in(static_cast<uint8_t>(ty_tbl->getNumElements()));
+
+					v_acc = builder.CreateXor(v_acc, builder.CreateLoad(ty_i64, builder.CreateConstGEP2_64(ty_tbl, g_tbl, 0, idx)));
+
+					break;
+
+				}
+
+			}
+
+		}
+
+		builder.CreateRet(v_acc);
+
+		return mod;
+
+	}
+
+	void obfuscate_module(Module& mod) {
+
+		selection::selector sel(mod);
+
+		// Budget is raised so zero identities get mixed in as well
+		transforms::mba_options opts_mba = {};
+		opts_mba.budget = 32;
+
+		transforms::encrypt_constant_pool(mod, sel, transforms::pool_options());
+		transforms::rewrite_mba(mod, sel, opts_mba);
+		transforms::obfuscate_constants(mod, sel, transforms::consts_options());
+		transforms::obfuscate_string_literals(mod, sel, transforms::strings_options());
+		transforms::obfuscate_references(mod, sel, transforms::refs_options());
+		transforms::split_blocks(mod, sel, transforms::split_options());
+		transforms::bogus_control_flow(mod, sel, transforms::bcf_options());
+		transforms::canonicalize_pointer_arithmetic(mod, sel);
+
+	}
+
+	[[noreturn]] void report_failure(const Twine& reason, StringRef str_mod_plain) {
+
+		errs() << "ux-fuzz: " << reason << "\n\nOriginal module:\n" << str_mod_plain;
+
+		std::abort();
+
+	}
+
+	std::unique_ptr<orc::LLJIT> create_jit() {
+
+		auto jit = orc::LLJITBuilder().create();
+
+		if (!jit) report_fatal_error(jit.takeError());
+
+		return std::move(*jit);
+
+	}
+
+	entry_fn_t load_module(orc::LLJIT& jit, std::unique_ptr<Module> mod, orc::ThreadSafeContext& ts_ctx) {
+
+		if (Error err = jit.addIRModule(orc::ThreadSafeModule(std::move(mod), ts_ctx)))
+			report_fatal_error(std::move(err));
+
+		// Runs the constructors, the pool is decoded by one
+		if (Error err = jit.initialize(jit.getMainJITDylib()))
+			report_fatal_error(std::move(err));
+
+		auto sym_entry = jit.lookup(ENTRY_NAME);
+
+		if (!sym_entry) report_fatal_error(sym_entry.takeError());
+
+		return sym_entry->toPtr<entry_fn_t>();
+
+	}
+
+	/* Calls the entry '-ux-fuzz-runs' times, results are stored for the comparison */
+	double run_timed(entry_fn_t fn_entry, std::vector<uint64_t>& results_out) {
+
+		auto tm_start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < results_out.size(); ++i)
+			results_out[i] = fn_entry();
+
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tm_start).count();
+
+	}
+
+	/* Slowdown of the inputs whose original module ran at least '-ux-fuzz-min-timed-us' */
+	struct slowdown_summary {
+
+		size_t n_inputs = 0;
+		size_t n_timed = 0;
+		double ratio_sum = 0;
+		double ratio_max = 0;
+
+	} summary;
+
+	void print_summary() {
+
+		errs() << "ux-fuzz: " << summary.n_inputs << " input(s), " << summary.n_timed << " timed";
+
+		if (summary.n_timed)
+			errs() << ", slowdown max " << format("%.1f", summary.ratio_max) << "x, mean "
+				<< format("%.1f", summary.ratio_sum / summary.n_timed) << "x";
+
+		errs() << "\n";
+
+	}
+
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+
+	InitializeNativeTarget();
+	InitializeNativeTargetAsmPrinter();
+
+	parseFuzzerCLOpts(*argc, *argv);
+
+	// errs() is created first so it's still alive when the summary is printed
+	errs().flush();
+	std::atexit(print_summary);
+
+	return 0;
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+
+	if (!size) return 0;
+
+	byte_reader reader = { data, size };
+
+	auto jit_plain = create_jit();
+	auto jit_obf = create_jit();
+
+	orc::ThreadSafeContext ts_ctx(std::make_unique<LLVMContext>());
+
+	auto mod_plain = create_fuzz_module(*ts_ctx.getContext(), reader, *jit_plain);
+	auto mod_obf = CloneModule(*mod_plain);
+
+	std::string str_plain;
+	raw_string_ostream(str_plain) << *mod_plain;
+
+	obfuscate_module(*mod_obf);
+
+	std::string err_verify;
+	raw_string_ostream out_verify(err_verify);
+
+	if (verifyModule(*mod_obf, &out_verify))
+		report_failure("Obfuscated module is broken:\n" + out_verify.str(), str_plain);
+
+	entry_fn_t fn_plain = load_module(*jit_plain, std::move(mod_plain), ts_ctx);
+	entry_fn_t fn_obf = load_module(*jit_obf, std::move(mod_obf), ts_ctx);
+
+	std::vector<uint64_t> results_plain(NumRuns), results_obf(NumRuns);
+
+	double tm_plain = run_timed(fn_plain, results_plain);
+	double tm_obf = run_timed(fn_obf, results_obf);
+
+	for (size_t i = 0; i < results_plain.size(); ++i) {
+
+		if (results_plain[i] == results_obf[i]) continue;
+
+		report_failure("Call " + Twine(i) + " returned " + utohexstr(results_obf[i])
+			+ ", expected " + utohexstr(results_plain[i]), str_plain);
+
+	}
+
+	double ratio_slowdown = tm_obf / std::max(tm_plain, 1e-3);
+
+	summary.n_inputs++;
+
+	if (tm_plain < MinTimedUs) return 0;
+
+	summary.n_timed++;
+	summary.ratio_sum += ratio_slowdown;
+	summary.ratio_max = std::max(summary.ratio_max, ratio_slowdown);
+
+	if (ratio_slowdown > MaxSlowdown) {
+
+		std::string str_reason;
+
+		raw_string_ostream(str_reason) << "Obfuscated module is " << format("%.1f", ratio_slowdown) << "x slower ("
+			<< format("%.1f", tm_obf) << "us vs " << format("%.1f", tm_plain) << "us), limit is "
+			<< format("%.1f", MaxSlowdown.getValue()) << "x";
+
+		report_failure(str_reason, str_plain);
+
+	}
+
+	return 0;
+
+}
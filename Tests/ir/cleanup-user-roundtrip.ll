@@ -0,0 +1,16 @@
+; User round trip moving 'p' onto 'q': (int*)((uintptr_t)p + ((uintptr_t)q - (uintptr_t)p)).
+; It isn't tagged with !ux.obf, so ux-cleanup must leave the inttoptr alone, a GEP on 'p' would access 'q'.
+
+target datalayout = "e-m:w-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-windows-msvc"
+
+define i32 @read_through(ptr %p, ptr %q) {
+entry:
+  %int_p = ptrtoint ptr %p to i64
+  %int_q = ptrtoint ptr %q to i64
+  %delta = sub i64 %int_q, %int_p
+  %sum = add i64 %int_p, %delta
+  %ptr = inttoptr i64 %sum to ptr
+  %val = load i32, ptr %ptr, align 4
+  ret i32 %val
+}
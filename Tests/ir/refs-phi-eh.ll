@@ -0,0 +1,49 @@
+; Globals read by a PHI, by a landingpad clause and through llvm.threadlocal.address.
+; ux-refs has to rebuild the PHI's pointers at the end of the incoming blocks, and leave the landingpad
+; and the thread-local global alone, or the output doesn't verify.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@g = global i32 1
+@h = global i32 2
+@tls = thread_local global i32 3
+@_ZTIi = external constant ptr
+
+declare i32 @__gxx_personality_v0(...)
+declare void @may_throw()
+declare ptr @llvm.threadlocal.address.p0(ptr)
+
+define i32 @pick(i1 %c) {
+entry:
+  br i1 %c, label %left, label %right
+left:
+  br label %join
+right:
+  br label %join
+join:
+  %p = phi ptr [ @g, %left ], [ @h, %right ]
+  %v = load i32, ptr %p, align 4
+  ret i32 %v
+}
+
+define i32 @guarded() personality ptr @__gxx_personality_v0 {
+entry:
+  invoke void @may_throw()
+          to label %ok unwind label %lpad
+ok:
+  %v = load i32, ptr @g, align 4
+  ret i32 %v
+lpad:
+  %lp = landingpad { ptr, i32 }
+          catch ptr @_ZTIi
+  %w = load i32, ptr @h, align 4
+  ret i32 %w
+}
+
+define i32 @tls_read() {
+entry:
+  %p = call ptr @llvm.threadlocal.address.p0(ptr @tls)
+  %v = load i32, ptr %p, align 4
+  ret i32 %v
+}
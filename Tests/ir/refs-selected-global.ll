@@ -0,0 +1,30 @@
+; @secret is annotated with "ux:refs", and so is @selected. @unselected isn't: its read of @secret must be
+; left as it is, an annotated global doesn't make every function using it pay for the rewrite.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@secret = global i32 42
+@other = global i32 7
+
+@.str.ux = private unnamed_addr constant [8 x i8] c"ux:refs\00", section "llvm.metadata"
+@.str.file = private unnamed_addr constant [23 x i8] c"refs-selected-global.c\00", section "llvm.metadata"
+
+@llvm.global.annotations = appending global [2 x { ptr, ptr, ptr, i32, ptr }] [
+  { ptr, ptr, ptr, i32, ptr } { ptr @secret, ptr @.str.ux, ptr @.str.file, i32 1, ptr null },
+  { ptr, ptr, ptr, i32, ptr } { ptr @selected, ptr @.str.ux, ptr @.str.file, i32 3, ptr null }
+], section "llvm.metadata"
+
+define i32 @selected() {
+entry:
+  %v = load i32, ptr @secret, align 4
+  %w = load i32, ptr @other, align 4
+  %sum = add i32 %v, %w
+  ret i32 %sum
+}
+
+define i32 @unselected() {
+entry:
+  %v = load i32, ptr @secret, align 4
+  ret i32 %v
+}
@@ -0,0 +1,21 @@
+; Same literal as shared-decoder-b.ll: ux-strings<mode=shared> must emit the very same '__ux_str.<hash>'
+; decoder in both modules, since the linker keeps a single linkonce_odr copy of it.
+
+target datalayout = "e-m:w-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-windows-msvc"
+
+@.str.shared = private unnamed_addr constant [27 x i8] c"shared literal across TUs!\00"
+
+define internal ptr @_obf_str(ptr %str) section "._obf_str" {
+entry:
+  ret ptr %str
+}
+
+declare i32 @puts(ptr)
+
+define i32 @print_a() {
+entry:
+  %str = call ptr @_obf_str(ptr @.str.shared)
+  %res = call i32 @puts(ptr %str)
+  ret i32 %res
+}
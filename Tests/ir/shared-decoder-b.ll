@@ -0,0 +1,31 @@
+; Decodes another literal first and calls the shared one from a different function, the decoder
+; of the shared literal must still match the one of shared-decoder-a.ll byte for byte.
+
+target datalayout = "e-m:w-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-windows-msvc"
+
+@.str.own = private unnamed_addr constant [14 x i8] c"only module b\00"
+@.str.shared = private unnamed_addr constant [27 x i8] c"shared literal across TUs!\00"
+
+define internal ptr @_obf_str(ptr %str) section "._obf_str" {
+entry:
+  ret ptr %str
+}
+
+declare i32 @puts(ptr)
+
+define i32 @print_own() {
+entry:
+  %str = call ptr @_obf_str(ptr @.str.own)
+  %res = call i32 @puts(ptr %str)
+  ret i32 %res
+}
+
+define i32 @print_b(i32 %n) {
+entry:
+  %twice = shl i32 %n, 1
+  %str = call ptr @_obf_str(ptr @.str.shared)
+  %res = call i32 @puts(ptr %str)
+  %sum = add i32 %res, %twice
+  ret i32 %sum
+}
@@ -0,0 +1,165 @@
+#!/bin/bash
+
+# Compile-time benchmark of the obfuscation passes on synthetic modules of increasing size.
+# Records wall time, transform time (reported by the plugin), peak RSS and IR instruction growth
+# of every pass for every scale, and saves them as JSON to find super-linear scaling.
+#
+# Usage: ./run-compile-bench.sh [scales file]
+#
+# Each line of the scales file is: <name> <functions> <strings per function> <string length> <globals> <block size>
+
+LIBBUILDDIR="${UX_LLVM_BUILD_DIR:-/home/cbsahmet/Dev/llvm/llvm-project/build}"
+
+LIBPATH=$LIBBUILDDIR"/lib/UX-Obfuscator.so"
+
+if [ ! -f $LIBPATH ]; then
+
+	echo "Plugin not found on path: "$LIBPATH" (set UX_LLVM_BUILD_DIR to the LLVM build directory)"
+
+	exit 1
+
+fi
+
+BENCHDIR="./binaries/bench"
+BENCHOUTPUTPATH=$BENCHDIR"/compile-bench.json"
+
+mkdir -p $BENCHDIR
+
+DEFAULTSCALES="fn-100 100 4 16 16 32
+fn-200 200 4 16 16 32
+fn-400 400 4 16 16 32
+fn-800 800 4 16 16 32
+strs-8 100 8 16 16 32
+strs-16 100 16 16 16 32
+strlen-64 100 4 64 16 32
+strlen-256 100 4 256 16 32
+globals-256 100 4 16 256 32
+block-128 100 4 16 16 128
+block-512 100 4 16 16 512"
+
+if [ $# -ge 1 ]; then
+
+	SCALES=$(cat $1)
+
+else
+
+	SCALES=$DEFAULTSCALES
+
+fi
+
+OPTPASSES="ux-strings ux-refs ux-split"
+
+# Counts instructions inside function bodies of a textual IR file
+count_instructions() {
+
+	awk '/^define / { body = 1; next } /^}/ { body = 0; next }
+		body && NF > 0 && $1 !~ /:$/ && $1 !~ /^;/ { n++ } END { print n + 0 }' $1
+
+}
+
+# Runs a command under /usr/bin/time and prints "<wall seconds> <peak rss kb>"
+measure() {
+
+	/usr/bin/time -f "%e %M" -o $BENCHDIR/time.txt "$@" > /dev/null 2> $BENCHDIR/stderr.txt
+
+	ERRCODE=$?
+	if [ $ERRCODE -ne 0 ]; then
+
+		echo "Benchmarked command failed with status code: "$ERRCODE >&2
+		cat $BENCHDIR/stderr.txt >&2
+
+		return 1
+
+	fi
+
+	cat $BENCHDIR/time.txt
+
+}
+
+echo "Running WareVisor compile-time benchmarks..."
+
+FIRSTRESULT=1
+
+{
+
+echo "{"
+echo "  \"results\": ["
+
+while read -r NAME NFUNCTIONS NSTRINGS SZSTRING NGLOBALS SZBLOCK; do
+
+	[ -z "$NAME" ] && continue
+
+	MODULEPATH=$BENCHDIR"/"$NAME".ll"
+
+	./bench/gen-module.sh $NFUNCTIONS $NSTRINGS $SZSTRING $NGLOBALS $SZBLOCK > $MODULEPATH || exit 1
+
+	NINSBEFORE=$(count_instructions $MODULEPATH)
+
+	for PASS in $OPTPASSES; do
+
+		OBFMODULEPATH=$BENCHDIR"/"$NAME"."$PASS".ll"
+		STATSPATH=$BENCHDIR"/"$NAME"."$PASS".json"
+
+		rm -f $STATSPATH
+
+		RESULT=$(measure opt --load-pass-plugin=$LIBPATH $MODULEPATH --passes=$PASS \
+			-ux-stats-json=$STATSPATH -S -o $OBFMODULEPATH) || exit 1
+
+		read -r WALL RSS <<< "$RESULT"
+
+		PASSTIME=$(grep -o '"time_ms": [0-9.eE+-]*' $STATSPATH | head -1 | awk '{ print $2 }')
+
+		NINSAFTER=$(count_instructions $OBFMODULEPATH)
+
+		echo "["$NAME"] "$PASS": "$WALL"s wall, "$PASSTIME"ms in pass, "$RSS"KB peak RSS, "$NINSBEFORE" -> "$NINSAFTER" instructions" >&2
+
+		[ $FIRSTRESULT -eq 0 ] && echo "    ,"
+		FIRSTRESULT=0
+
+		echo "    { \"scale\": \"$NAME\", \"functions\": $NFUNCTIONS, \"strings_per_function\": $NSTRINGS,"
+		echo "      \"string_length\": $SZSTRING, \"globals\": $NGLOBALS, \"block_size\": $SZBLOCK,"
+		echo "      \"pass\": \"$PASS\", \"wall_s\": $WALL, \"pass_ms\": ${PASSTIME:-0}, \"peak_rss_kb\": $RSS,"
+		echo "      \"instructions_before\": $NINSBEFORE, \"instructions_after\": $NINSAFTER }"
+
+	done
+
+	# MIR pass runs inside codegen, so it is measured against the same llc run without it
+
+	OBFMODULEPATH=$BENCHDIR"/"$NAME".ux-refs.ll"
+
+	RESULT=$(measure llc --load=$LIBPATH -filetype=obj -wv-mir-in-pipeline=false \
+		$OBFMODULEPATH -o $BENCHDIR/$NAME.o) || exit 1
+
+	read -r WALLBASE RSSBASE <<< "$RESULT"
+
+	RESULT=$(measure llc --load=$LIBPATH -filetype=obj $OBFMODULEPATH -o $BENCHDIR/$NAME.o) || exit 1
+
+	read -r WALL RSS <<< "$RESULT"
+
+	echo "["$NAME"] wv-mir-pass: "$WALL"s wall ("$WALLBASE"s without), "$RSS"KB peak RSS ("$RSSBASE"KB without)" >&2
+
+	echo "    ,"
+	echo "    { \"scale\": \"$NAME\", \"functions\": $NFUNCTIONS, \"strings_per_function\": $NSTRINGS,"
+	echo "      \"string_length\": $SZSTRING, \"globals\": $NGLOBALS, \"block_size\": $SZBLOCK,"
+	echo "      \"pass\": \"wv-mir-pass\", \"wall_s\": $WALL, \"wall_s_without\": $WALLBASE,"
+	echo "      \"peak_rss_kb\": $RSS, \"peak_rss_kb_without\": $RSSBASE }"
+
+done <<< "$SCALES"
+
+echo "  ]"
+echo "}"
+
+} > $BENCHOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Compile-time benchmarks failed with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+echo "Results are saved to: "$BENCHOUTPUTPATH
+
+exit 0
@@ -1,7 +1,5 @@
 #!/bin/bash
 
-LLCPASSES="wv-mir-pass"
-
 if [ $# -le 0 ]; then
 
 	echo "Please specify an input file (C/C++) to produce."
@@ -16,42 +14,38 @@ echo "Running WareVisor (LLC) tests on file <"$1">..."
 
 OBFIRINPUTPATH="./binaries/ir-out-obf.ll"
 
-LIBBUILDDIR="/home/cbsahmet/Dev/llvm/llvm-project/build"
+LIBBUILDDIR="${UX_LLVM_BUILD_DIR:-/home/cbsahmet/Dev/llvm/llvm-project/build}"
 
 LIBPATH=$LIBBUILDDIR"/lib/UX-Obfuscator.so"
 
-OBFMIROUTPUTPATH="./binaries/mir-out-obf.mir"
+OBFFINALASMOUTPUTPATH="./binaries/final-asm-out-obf.asm"
+OBFFINALOBJOUTPUTPATH="./binaries/final-obj-out-obf.o"
 
-llc -mtriple=x86_64-pc-windows-msvc --stop-after="x86-isel" $OBFIRINPUTPATH -o $OBFMIROUTPUTPATH
+# MIR pass is inserted right after x86-isel by the plugin itself, so the whole
+# codegen pipeline runs in-memory through a single llc invocation
+
+llc -mtriple=x86_64-pc-windows-msvc --load=$LIBPATH --filetype=obj $OBFIRINPUTPATH -o $OBFFINALOBJOUTPUTPATH
 
 ERRCODE=$?
 if [ $ERRCODE -ne 0 ]; then
 
-	echo "Compilation until x86-isel failed [LLC] with status code: "$ERRCODE
+	echo "Running codegen pipeline with the plugin loaded failed [LLC] with status code: "$ERRCODE
 
 	exit 1
 
 fi
 
-OBFMIRNEXTOUTPUTPATH="./binaries/mir-out-obf-next.mir"
-
-llc -mtriple=x86_64-pc-windows-msvc --load=$LIBPATH --run-pass=$LLCPASSES $OBFMIROUTPUTPATH -o $OBFMIRNEXTOUTPUTPATH
+objdump -d -M intel $OBFFINALOBJOUTPUTPATH > $OBFFINALASMOUTPUTPATH
 
 ERRCODE=$?
 if [ $ERRCODE -ne 0 ]; then
 
-	echo "Running passes after x86-isel failed [LLC] with status code: "$ERRCODE
-	
+	echo "Disassembling output object failed (Objdump) with status code: "$ERRCODE
+
 	exit 1
 
 fi
 
-OBFFINALASMOUTPUTPATH="./binaries/final-asm-out-obf.asm"
-OBFFINALOBJOUTPUTPATH="./binaries/final-obj-out-obf.o"
-
-llc -mtriple=x86_64-pc-windows-msvc --start-after="x86-isel" --x86-asm-syntax=intel $OBFMIRNEXTOUTPUTPATH -o $OBFFINALASMOUTPUTPATH
-llc -mtriple=x86_64-pc-windows-msvc --start-after="x86-isel" --filetype=obj $OBFMIRNEXTOUTPUTPATH -o $OBFFINALOBJOUTPUTPATH
-
 echo "LLC tests are performed successfully."
 
 exit 0
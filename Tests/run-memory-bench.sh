@@ -0,0 +1,121 @@
+#!/bin/bash
+
+# Memory regression test on a synthetic module of about one million instructions. Peak RSS of opt
+# parsing and verifying the module alone is taken as the base, then every pass is run on its own and
+# the RSS it takes over the base is saved as JSON. Overhead is mostly the IR the pass adds, scratch state
+# kept for the whole module would show up on top of it. Test fails if a pass takes more than
+# UX_MEM_OVERHEAD_PCT percent (100 by default) of the base over it, or more than UX_MEM_LIMIT_KB in total.
+#
+# Usage: ./run-memory-bench.sh [functions] [block size]
+
+LIBBUILDDIR="${UX_LLVM_BUILD_DIR:-/home/cbsahmet/Dev/llvm/llvm-project/build}"
+
+LIBPATH=$LIBBUILDDIR"/lib/UX-Obfuscator.so"
+
+if [ ! -f $LIBPATH ]; then
+
+	echo "Plugin not found on path: "$LIBPATH" (set UX_LLVM_BUILD_DIR to the LLVM build directory)"
+
+	exit 1
+
+fi
+
+BENCHDIR="./binaries/bench"
+BENCHOUTPUTPATH=$BENCHDIR"/memory-bench.json"
+
+mkdir -p $BENCHDIR
+
+# 2000 functions of ~500 instructions each
+NFUNCTIONS=${1:-2000}
+SZBLOCK=${2:-480}
+
+OPTPASSES="ux-strings ux-refs"
+
+MODULEPATH=$BENCHDIR"/memory-bench.ll"
+
+./bench/gen-module.sh $NFUNCTIONS 2 16 64 $SZBLOCK > $MODULEPATH || exit 1
+
+# Runs opt under /usr/bin/time and prints the peak RSS in KB
+measure_rss() {
+
+	/usr/bin/time -f "%M" -o $BENCHDIR/time.txt opt --load-pass-plugin=$LIBPATH $MODULEPATH \
+		"$@" -disable-output 2> $BENCHDIR/stderr.txt
+
+	ERRCODE=$?
+	if [ $ERRCODE -ne 0 ]; then
+
+		echo "Benchmarked command failed with status code: "$ERRCODE >&2
+		cat $BENCHDIR/stderr.txt >&2
+
+		return 1
+
+	fi
+
+	cat $BENCHDIR/time.txt
+
+}
+
+echo "Running WareVisor memory benchmarks..."
+
+MAXOVERHEADPCT=${UX_MEM_OVERHEAD_PCT:-100}
+
+RSSBASE=$(measure_rss --passes=verify) || exit 1
+
+echo "[base] "$RSSBASE"KB peak RSS parsing the module" >&2
+
+FAILED=0
+FIRSTRESULT=1
+
+{
+
+echo "{"
+echo "  \"functions\": $NFUNCTIONS, \"block_size\": $SZBLOCK, \"base_peak_rss_kb\": $RSSBASE,"
+echo "  \"results\": ["
+
+for PASS in $OPTPASSES; do
+
+	RSS=$(measure_rss --passes=$PASS) || exit 1
+
+	RSSOVERHEAD=$((RSS > RSSBASE ? RSS - RSSBASE : 0))
+
+	echo "["$PASS"] "$RSS"KB peak RSS, "$RSSOVERHEAD"KB over the base" >&2
+
+	if [ $((RSSOVERHEAD * 100)) -gt $((RSSBASE * MAXOVERHEADPCT)) ]; then
+
+		echo "["$PASS"] Pass takes more than "$MAXOVERHEADPCT"% of the module's memory over it." >&2
+
+		FAILED=1
+
+	fi
+
+	if [ -n "$UX_MEM_LIMIT_KB" ] && [ $RSS -gt $UX_MEM_LIMIT_KB ]; then
+
+		echo "["$PASS"] Pass exceeds the memory limit of "$UX_MEM_LIMIT_KB"KB." >&2
+
+		FAILED=1
+
+	fi
+
+	[ $FIRSTRESULT -eq 0 ] && echo "    ,"
+	FIRSTRESULT=0
+
+	echo "    { \"pass\": \"$PASS\", \"peak_rss_kb\": $RSS, \"overhead_kb\": $RSSOVERHEAD }"
+
+done
+
+echo "  ]"
+echo "}"
+
+} > $BENCHOUTPUTPATH || exit 1
+
+echo "Results are saved to: "$BENCHOUTPUTPATH
+
+if [ $FAILED -ne 0 ]; then
+
+	echo "Memory benchmarks failed."
+
+	exit 1
+
+fi
+
+exit 0
@@ -0,0 +1,208 @@
+#!/bin/bash
+
+# Runtime overhead benchmark of obfuscated binaries on x86_64 Linux.
+# Every kernel is compiled plain and with each obfuscation mode, then run under perf counters
+# (or TSC cycles printed by the kernel when perf is not available). Cycles, instructions,
+# branch-misses and .text size deltas against the plain build are reported per transform.
+#
+# Usage: ./run-runtime-bench.sh [iterations]
+
+LIBBUILDDIR="${UX_LLVM_BUILD_DIR:-/home/cbsahmet/Dev/llvm/llvm-project/build}"
+
+LIBPATH=$LIBBUILDDIR"/lib/UX-Obfuscator.so"
+
+if [ ! -f $LIBPATH ]; then
+
+	echo "Plugin not found on path: "$LIBPATH" (set UX_LLVM_BUILD_DIR to the LLVM build directory)"
+
+	exit 1
+
+fi
+
+ITERATIONS=${1:-1000000}
+
+TARGET="x86_64-pc-linux-gnu"
+
+BENCHDIR="./binaries/bench/runtime"
+BENCHOUTPUTPATH="./binaries/bench/runtime-bench.json"
+
+mkdir -p $BENCHDIR
+
+KERNELS="strings table loop parser"
+
+# <mode name> <opt passes>, 'plain' is the baseline deltas are computed against
+MODES="plain -
+strings ux-strings
+refs ux-refs
+split ux-split
+all ux<strings;refs;split>"
+
+USEPERF=0
+
+if perf stat -x, -e cycles true > /dev/null 2>&1; then
+
+	USEPERF=1
+
+else
+
+	echo "perf counters are not available, falling back to TSC cycles (instructions and branch-misses are not reported)."
+
+fi
+
+# Prints "<cycles> <instructions> <branch-misses>" of a run, missing counters are printed as null
+run_counters() {
+
+	if [ $USEPERF -eq 1 ]; then
+
+		perf stat -x, -e cycles,instructions,branch-misses -o $BENCHDIR/perf.txt $1 $ITERATIONS > /dev/null 2>&1 || return 1
+
+		awk -F, '$3 ~ /^cycles/ { c = $1 } $3 ~ /^instructions/ { i = $1 } $3 ~ /^branch-misses/ { b = $1 }
+			END { print (c ~ /^[0-9]+$/ ? c : "null"), (i ~ /^[0-9]+$/ ? i : "null"), (b ~ /^[0-9]+$/ ? b : "null") }' $BENCHDIR/perf.txt
+
+	else
+
+		TSC=$($1 $ITERATIONS 2>&1 > /dev/null | grep -o 'tsc_cycles=[0-9]*' | cut -d= -f2)
+
+		[ -z "$TSC" ] && return 1
+
+		echo $TSC" null null"
+
+	fi
+
+}
+
+# Prints relative change of $2 against $1 in percent, or null if any of them is missing
+delta() {
+
+	if [ "$1" = "null" ] || [ "$2" = "null" ] || [ "$1" = "0" ]; then
+
+		echo "null"
+
+	else
+
+		awk -v a=$1 -v b=$2 'BEGIN { printf "%.2f", (b - a) * 100 / a }'
+
+	fi
+
+}
+
+echo "Running WareVisor runtime benchmarks ("$ITERATIONS" iterations)..."
+
+FIRSTRESULT=1
+
+{
+
+echo "{"
+echo "  \"target\": \"$TARGET\", \"iterations\": $ITERATIONS, \"perf\": $([ $USEPERF -eq 1 ] && echo true || echo false),"
+echo "  \"results\": ["
+
+for KERNEL in $KERNELS; do
+
+	IRPATH=$BENCHDIR"/"$KERNEL".ll"
+
+	# optnone would keep -O2 from optimizing the IR afterwards
+	clang++ -target $TARGET -S -emit-llvm -O0 -Xclang -disable-O0-optnone ./bench/kernels/$KERNEL.cpp -o $IRPATH
+
+	ERRCODE=$?
+	if [ $ERRCODE -ne 0 ]; then
+
+		echo "Compilation of kernel <"$KERNEL"> failed [Clang] with status code: "$ERRCODE >&2
+
+		exit 1
+
+	fi
+
+	while read -r MODE PASSES; do
+
+		OBFIRPATH=$BENCHDIR"/"$KERNEL"."$MODE".ll"
+		BINPATH=$BENCHDIR"/"$KERNEL"."$MODE".bin"
+
+		if [ "$PASSES" = "-" ]; then
+
+			cp $IRPATH $OBFIRPATH
+
+		else
+
+			opt --load-pass-plugin=$LIBPATH $IRPATH "--passes=$PASSES" -S -o $OBFIRPATH
+
+			ERRCODE=$?
+			if [ $ERRCODE -ne 0 ]; then
+
+				echo "Running passes <"$PASSES"> on kernel <"$KERNEL"> failed [Opt] with status code: "$ERRCODE >&2
+
+				exit 1
+
+			fi
+
+		fi
+
+		clang++ -target $TARGET -O2 $OBFIRPATH -o $BINPATH
+
+		ERRCODE=$?
+		if [ $ERRCODE -ne 0 ]; then
+
+			echo "Compilation of kernel <"$KERNEL"> ("$MODE") failed [Clang] with status code: "$ERRCODE >&2
+
+			exit 1
+
+		fi
+
+		COUNTERS=$(run_counters $BINPATH)
+
+		if [ $? -ne 0 ]; then
+
+			echo "Running kernel <"$KERNEL"> ("$MODE") failed." >&2
+
+			exit 1
+
+		fi
+
+		read -r CYCLES INSTRUCTIONS BRANCHMISSES <<< "$COUNTERS"
+
+		TEXTSIZE=$(size -A $BINPATH | awk '$1 == ".text" { print $2 }')
+
+		if [ "$MODE" = "plain" ]; then
+
+			BASECYCLES=$CYCLES
+			BASEINSTRUCTIONS=$INSTRUCTIONS
+			BASEBRANCHMISSES=$BRANCHMISSES
+			BASETEXTSIZE=$TEXTSIZE
+
+		fi
+
+		DCYCLES=$(delta $BASECYCLES $CYCLES)
+		DINSTRUCTIONS=$(delta $BASEINSTRUCTIONS $INSTRUCTIONS)
+		DBRANCHMISSES=$(delta $BASEBRANCHMISSES $BRANCHMISSES)
+		DTEXTSIZE=$(delta $BASETEXTSIZE $TEXTSIZE)
+
+		echo "["$KERNEL"] "$MODE": cycles "$CYCLES" ("$DCYCLES"%), instructions "$INSTRUCTIONS" ("$DINSTRUCTIONS"%), branch-misses "$BRANCHMISSES" ("$DBRANCHMISSES"%), .text "$TEXTSIZE" ("$DTEXTSIZE"%)" >&2
+
+		[ $FIRSTRESULT -eq 0 ] && echo "    ,"
+		FIRSTRESULT=0
+
+		echo "    { \"kernel\": \"$KERNEL\", \"mode\": \"$MODE\","
+		echo "      \"cycles\": $CYCLES, \"instructions\": $INSTRUCTIONS, \"branch_misses\": $BRANCHMISSES, \"text_size\": $TEXTSIZE,"
+		echo "      \"cycles_delta_pct\": $DCYCLES, \"instructions_delta_pct\": $DINSTRUCTIONS,"
+		echo "      \"branch_misses_delta_pct\": $DBRANCHMISSES, \"text_size_delta_pct\": $DTEXTSIZE }"
+
+	done <<< "$MODES"
+
+done
+
+echo "  ]"
+echo "}"
+
+} > $BENCHOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Runtime benchmarks failed with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+echo "Results are saved to: "$BENCHOUTPUTPATH
+
+exit 0
@@ -35,7 +35,7 @@ if [ $ERRCODE -ne 0 ]; then
 
 fi
 
-LIBBUILDDIR="/home/cbsahmet/Dev/llvm/llvm-project/build"
+LIBBUILDDIR="${UX_LLVM_BUILD_DIR:-/home/cbsahmet/Dev/llvm/llvm-project/build}"
 
 ninja -C $LIBBUILDDIR UX-Obfuscator
 
@@ -64,6 +64,19 @@ if [ $ERRCODE -ne 0 ]; then
 fi
 
 echo "Passes are applied successfully."
+
+# Reports how much of the generated code (tagged with !ux.obf) is left after -O2
+opt -mtriple=x86_64-pc-windows-msvc --load-pass-plugin=$LIBPATH $OBFIROUTPUTPATH --passes="default<O2>,ux-survival" -disable-output
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Survival report failed [Opt] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
 echo "Now resultant IR is being compiled to target assembly and machine code..."
 
 BINOUTPUTPATH="./binaries/bin-out-obf.bin"
@@ -92,4 +105,225 @@ fi
 
 echo "Main tests are performed successfully."
 
+IRTESTDIR="./ir"
+
+# ux-cleanup must not rewrite round trips of user code, the pointer may be moved onto another object
+CLEANUPOUTPUTPATH="./binaries/cleanup-user-roundtrip.ll"
+
+opt --load-pass-plugin=$LIBPATH $IRTESTDIR/cleanup-user-roundtrip.ll --passes=ux-cleanup -S -o $CLEANUPOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Running ux-cleanup failed [Opt] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+if ! grep -q "inttoptr" $CLEANUPOUTPUTPATH || grep -q "getelementptr" $CLEANUPOUTPUTPATH; then
+
+	echo "ux-cleanup rewrote a round trip of user code into a GEP."
+
+	exit 1
+
+fi
+
+# ux-refs must rebuild pointers read by PHIs on their incoming edges, and leave EH pads and thread-locals alone
+REFSOUTPUTPATH="./binaries/refs-phi-eh.ll"
+
+opt --load-pass-plugin=$LIBPATH $IRTESTDIR/refs-phi-eh.ll --passes=ux-refs -S -o $REFSOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Running ux-refs failed [Opt] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+if grep -q "phi ptr \[ @" $REFSOUTPUTPATH || ! grep -q "catch ptr @_ZTIi" $REFSOUTPUTPATH \
+	|| ! grep -q "threadlocal.address.p0(ptr @tls)" $REFSOUTPUTPATH; then
+
+	echo "ux-refs left a PHI on a global, or rewrote a landingpad or a thread-local."
+
+	exit 1
+
+fi
+
+# An annotated global is only rewritten in selected functions, unselected ones don't pay for it
+SELOUTPUTPATH="./binaries/refs-selected-global.ll"
+
+opt --load-pass-plugin=$LIBPATH $IRTESTDIR/refs-selected-global.ll --passes=ux-refs -S -o $SELOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Running ux-refs on an annotated global failed [Opt] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+if ! sed -n "/^define .*@unselected(/,/^}/p" $SELOUTPUTPATH | grep -q "load i32, ptr @secret" \
+	|| sed -n "/^define .*@selected(/,/^}/p" $SELOUTPUTPATH | grep -q "load i32, ptr @secret"; then
+
+	echo "ux-refs rewrote an annotated global outside of the selected functions, or not in them."
+
+	exit 1
+
+fi
+
+# Same literal in two modules must get byte-identical linkonce_odr decoders, metadata numbering aside
+for SHAREDMODULE in a b; do
+
+	opt --load-pass-plugin=$LIBPATH $IRTESTDIR/shared-decoder-$SHAREDMODULE.ll --passes="ux-strings<mode=shared>" \
+		-S -o ./binaries/shared-decoder-$SHAREDMODULE.ll
+
+	ERRCODE=$?
+	if [ $ERRCODE -ne 0 ]; then
+
+		echo "Running ux-strings (shared) failed [Opt] with status code: "$ERRCODE
+
+		exit 1
+
+	fi
+
+done
+
+DECODERNAME=$(grep -o "@__ux_str\.[0-9a-f]*(" ./binaries/shared-decoder-a.ll | head -n 1 | tr -d "@(")
+
+if [ -z "$DECODERNAME" ]; then
+
+	echo "ux-strings (shared) didn't emit any decoder."
+
+	exit 1
+
+fi
+
+for SHAREDMODULE in a b; do
+
+	sed -n "/^define .*@$DECODERNAME(/,/^}/p" ./binaries/shared-decoder-$SHAREDMODULE.ll \
+		| sed "s/, !ux.obf ![0-9]*//" > ./binaries/shared-decoder-$SHAREDMODULE.body
+
+done
+
+if [ ! -s ./binaries/shared-decoder-b.body ] \
+	|| ! diff -q ./binaries/shared-decoder-a.body ./binaries/shared-decoder-b.body > /dev/null; then
+
+	echo "Decoder "$DECODERNAME" differs across modules using the same literal."
+
+	exit 1
+
+fi
+
+# Strings rebuilt by the keystream encoding must decode to the originals at runtime
+KSIROUTPUTPATH="./binaries/keystream-output.ll"
+KSOBFIROUTPUTPATH="./binaries/keystream-out-obf.ll"
+KSBINOUTPUTPATH="./binaries/keystream-out-obf.bin"
+
+clang++ -S -emit-llvm -O0 ./src/keystream.cpp -o $KSIROUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Compilation of keystream test failed [Clang] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+opt --load-pass-plugin=$LIBPATH $KSIROUTPUTPATH --passes="ux-strings<mode=inline;encoding=keystream>" -S -o $KSOBFIROUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Running ux-strings (keystream) failed [Opt] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+clang++ -O2 $KSOBFIROUTPUTPATH -o $KSBINOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Compilation of keystream IR failed [Clang] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+$KSBINOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Keystream strings don't decode to the originals, status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+# Tables moved into the encrypted pool must read back as they were once its constructor has run
+POOLIROUTPUTPATH="./binaries/pool-output.ll"
+POOLOBFIROUTPUTPATH="./binaries/pool-out-obf.ll"
+POOLBINOUTPUTPATH="./binaries/pool-out-obf.bin"
+
+clang++ -S -emit-llvm -O0 ./src/pool.cpp -o $POOLIROUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Compilation of pool test failed [Clang] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+opt --load-pass-plugin=$LIBPATH $POOLIROUTPUTPATH --passes=ux-pool -S -o $POOLOBFIROUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Running ux-pool failed [Opt] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+if ! grep -q "__ux_pool" $POOLOBFIROUTPUTPATH; then
+
+	echo "ux-pool didn't move any table into the pool."
+
+	exit 1
+
+fi
+
+clang++ -O2 $POOLOBFIROUTPUTPATH -o $POOLBINOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Compilation of pooled IR failed [Clang] with status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+$POOLBINOUTPUTPATH
+
+ERRCODE=$?
+if [ $ERRCODE -ne 0 ]; then
+
+	echo "Pooled tables don't read back correctly, status code: "$ERRCODE
+
+	exit 1
+
+fi
+
+echo "IR tests are performed successfully."
+
 exit 0
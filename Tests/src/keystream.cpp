@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/defs.hpp"
+
+// Literals of every length class around the 8-byte words of the keystream, each one rebuilt
+// by ux-strings<encoding=keystream> must read back as the original
+
+struct Expected {
+
+	const char* rebuilt;
+	const char* plain;
+
+};
+
+int main() {
+
+	const Expected strings[] = {
+
+		{ OBFUSCATE(""), "" },
+		{ OBFUSCATE("k"), "k" },
+		{ OBFUSCATE("1234567"), "1234567" },
+		{ OBFUSCATE("12345678"), "12345678" },
+		{ OBFUSCATE("123456789"), "123456789" },
+		{ OBFUSCATE("0123456789abcdef"), "0123456789abcdef" },
+		{ OBFUSCATE("keystream seeded by a single opaque equation, 8 bytes per xorshift step"),
+			"keystream seeded by a single opaque equation, 8 bytes per xorshift step" }
+
+	};
+
+	int n_failed = 0;
+
+	for (const Expected& str : strings) {
+
+		if (strcmp(str.rebuilt, str.plain) == 0) continue;
+
+		printf("Keystream string <%s> is decoded as <%s>\n", str.plain, str.rebuilt);
+
+		n_failed++;
+
+	}
+
+	printf("%d keystream string(s) decoded wrong.\n", n_failed);
+
+	return n_failed ? 1 : 0;
+
+}
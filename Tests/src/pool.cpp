@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdint.h>
+
+// Internal constant tables which ux-pool moves into '__ux_pool', decoded by a constructor before main
+
+struct Mixed {
+
+	int8_t tip;
+	int16_t delta;
+	uint64_t key;
+	double scale;
+
+};
+
+static const int32_t table[6] = { 1, -2, 0x12345678, 0, 0xFFFF, (int32_t)0xDEADBEEF };
+
+static const Mixed mixed = { 7, -3, 0x0123456789ABCDEF, 2.5 };
+
+// Zero-sized, so it isn't pooled: it would share its offset with the next member
+static const int32_t empty[0] = {};
+
+int main() {
+
+	bool same = table[0] == 1 && table[1] == -2 && table[2] == 0x12345678 && table[3] == 0
+		&& table[4] == 0xFFFF && table[5] == (int32_t)0xDEADBEEF
+		&& mixed.tip == 7 && mixed.delta == -3 && mixed.key == 0x0123456789ABCDEF && mixed.scale == 2.5
+		&& (const void*)empty != (const void*)table;
+
+	printf("Pooled tables %s\n", same ? "read back correctly." : "are corrupted!");
+
+	return same ? 0 : 1;
+
+}
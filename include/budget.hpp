@@ -0,0 +1,73 @@
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/IR/Function.h"
+
+#include "include/selection.hpp"
+
+
+namespace budget {
+
+    /* Function metadata holding its instruction count before any transform expanded it: !ux.budget !{i64 N} */
+    constexpr const char* MD_BUDGET = "ux.budget";
+
+    /*
+    Growth budget of the functions of a module, shared by every transform of the pipeline. With '-ux-budget=P'
+    each function may grow by P% of its size before obfuscation, or by '-ux-budget-min' instructions if that's more.
+    Size before obfuscation is kept on the function as MD_BUDGET by the first transform looking at it, and a
+    function has spent whatever it has grown since, so each pass sees what the earlier ones have added.
+
+    Budget is allocated by priority: a transform may only spend while the growth of the function stays under
+    its share of the budget (strings 100%, refs 90%, consts 75%, MBA 60%, BCF 50%, split 40%), so the lower
+    ones leave room to the higher ones whatever the order of the pipeline is.
+    Work which doesn't fit is skipped or downgraded to a cheaper form by the transform, and reported.
+
+    Without '-ux-budget', nothing is limited and functions aren't tagged.
+    */
+    class tracker {
+
+    public:
+
+        tracker(selection::kind k, llvm::StringRef pass_name);
+
+        bool is_enabled() const;
+
+        /* Instructions 'fn' can still grow by for the transform */
+        size_t remaining(llvm::Function& fn);
+
+        /* Whether 'fn' can grow by 'n_insts' for the transform, they're charged if so */
+        bool try_spend(llvm::Function& fn, size_t n_insts);
+
+        /* Charges 'n_insts' which are already added to 'fn' */
+        void charge(llvm::Function& fn, size_t n_insts);
+
+        /* Counts items of 'fn' left as is, or done in a cheaper form, since they didn't fit */
+        void skip(llvm::Function& fn, size_t n_items = 1);
+        void downgrade(llvm::Function& fn, size_t n_items = 1);
+
+        /* Logs and records (see stats::record_budget) every function which had work skipped or downgraded */
+        void report() const;
+
+    private:
+
+        struct function_state {
+            size_t n_limit = 0;
+            size_t n_spent = 0;
+            size_t n_skipped = 0;
+            size_t n_downgraded = 0;
+        };
+
+        function_state& get_state(llvm::Function& fn);
+
+        std::string pass_name;
+
+        unsigned share = 100; /* percent of the budget the transform may spend */
+
+        llvm::MapVector<llvm::Function*, function_state> states;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef EMIT_HPP
+#define EMIT_HPP
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+
+#include "include/win64_defs.hpp"
+
+#include <array>
+
+
+namespace emit {
+
+    /* Types looked up once, instead of going through the uniquing maps of the context on every emitted instruction */
+    struct types {
+
+        llvm::Type* ty_void;
+        llvm::IntegerType* ty_i8;
+        llvm::IntegerType* ty_i16;
+        llvm::IntegerType* ty_i32;
+        llvm::IntegerType* ty_i64;
+        llvm::PointerType* ty_ptr;
+
+        explicit types(llvm::LLVMContext& ctx)
+            : ty_void(llvm::Type::getVoidTy(ctx)),
+              ty_i8(llvm::Type::getInt8Ty(ctx)),
+              ty_i16(llvm::Type::getInt16Ty(ctx)),
+              ty_i32(llvm::Type::getInt32Ty(ctx)),
+              ty_i64(llvm::Type::getInt64Ty(ctx)),
+              ty_ptr(llvm::PointerType::get(ctx, 0)) {}
+
+        /* Integer type as wide as T, picked at compile time */
+        template <typename T>
+        llvm::IntegerType* get() const {
+
+            if constexpr (sizeof(T) == 1) return ty_i8;
+            else if constexpr (sizeof(T) == 2) return ty_i16;
+            else if constexpr (sizeof(T) == 4) return ty_i32;
+            else {
+                static_assert(sizeof(T) == 8, "Equations are generated on 8, 16, 32 or 64-bit integers only.");
+                return ty_i64;
+            }
+
+        }
+
+    };
+
+    /* Constants which every emitted opaque value or equation node would otherwise unique again */
+    struct constants {
+
+        llvm::ConstantInt* c_addr_ushd; /* i64 address of USER_SHARED_DATA */
+        llvm::ConstantInt* c_opaque_shift; /* i32 8, opaque byte is the second one of the loaded value */
+        llvm::ConstantInt* c_opaque_mask; /* i32 0xFF */
+
+        std::array<llvm::ConstantInt*, 4> c_shift_masks; /* width - 1 of i8/i16/i32/i64, masking shift amounts */
+
+        explicit constants(const types& tys)
+            : c_addr_ushd(llvm::ConstantInt::get(tys.ty_i64, ADDR_USER_SHARED_DATA)),
+              c_opaque_shift(llvm::ConstantInt::get(tys.ty_i32, 8)),
+              c_opaque_mask(llvm::ConstantInt::get(tys.ty_i32, 0xFF)),
+              c_shift_masks({
+                  llvm::ConstantInt::get(tys.ty_i8, 7),
+                  llvm::ConstantInt::get(tys.ty_i16, 15),
+                  llvm::ConstantInt::get(tys.ty_i32, 31),
+                  llvm::ConstantInt::get(tys.ty_i64, 63) }) {}
+
+        template <typename T>
+        llvm::ConstantInt* shift_mask() const {
+
+            if constexpr (sizeof(T) == 1) return c_shift_masks[0];
+            else if constexpr (sizeof(T) == 2) return c_shift_masks[1];
+            else if constexpr (sizeof(T) == 4) return c_shift_masks[2];
+            else return c_shift_masks[3];
+
+        }
+
+    };
+
+    /*
+    Host side state of a single transform run, passed to every emitter. Types and constants are looked
+    up once for the module, the builder is repositioned for every block it fills and scratch buffers are
+    overwritten per item, so nothing is allocated per string or reference.
+    It's created on the stack of the transform and must not outlive it.
+
+    Emitters append detached instructions to 'bl_scratch' (a block with no parent function, so appending
+    doesn't touch any symbol table), then the transform moves all of them to their destination with a
+    single 'splice_before'.
+    */
+    struct context {
+
+        llvm::Module& mod;
+        types tys;
+        constants consts;
+
+        llvm::IRBuilder<> builder;
+
+        llvm::SmallVector<char, 256> buf_bytes; /* encoded bytes of the literal being processed */
+
+        llvm::BasicBlock* bl_scratch;
+
+        explicit context(llvm::Module& mod)
+            : mod(mod), tys(mod.getContext()), consts(tys), builder(mod.getContext()),
+              bl_scratch(llvm::BasicBlock::Create(mod.getContext())) {}
+
+        ~context();
+
+        context(const context&) = delete;
+        context& operator=(const context&) = delete;
+
+        /* Appends a detached instruction to the scratch block */
+        void append(llvm::Instruction* inst) { inst->insertInto(bl_scratch, bl_scratch->end()); }
+
+        /* Appends an equation or opaque chain, every value of it is a detached instruction */
+        void append(llvm::ArrayRef<llvm::Value*> insts);
+        void append(llvm::ArrayRef<llvm::Instruction*> insts);
+
+        /* Tags the scratch block's instructions as generated by 'transform' and moves them before 'inst_pos' */
+        void splice_before(llvm::Instruction* inst_pos, llvm::StringRef transform);
+
+        /* Deletes the scratch block's instructions, when what's emitted isn't going to be used */
+        void discard();
+
+    };
+
+}
+
+#endif
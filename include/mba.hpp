@@ -0,0 +1,103 @@
+#ifndef MBA_HPP
+#define MBA_HPP
+
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instruction.h"
+
+#include <array>
+
+
+namespace mba {
+
+    /* Bitwise expressions of two operands which linear MBA identities are combined from */
+    enum class bexpr : uint8_t {
+
+        X, Y,
+        NOT_X, NOT_Y,
+        AND, OR, XOR,
+        X_AND_NOT_Y, NOT_X_AND_Y,
+        X_OR_NOT_Y, NOT_X_OR_Y,
+        NAND, NOR, XNOR,
+        ONES /* all bits set, -1 */
+
+    };
+
+    /* coef * expr(x, y) */
+    struct term {
+        int64_t coef;
+        bexpr expr;
+    };
+
+    constexpr size_t MAX_TERMS = 4;
+
+    /* Linear MBA form of 'x opcode y' as a sum of terms */
+    struct identity {
+        llvm::Instruction::BinaryOps opcode;
+        std::array<term, MAX_TERMS> terms;
+        size_t n_terms;
+    };
+
+    /*
+    Estimated cycles of an identity: one per bitwise or additive instruction, one per shift
+    for power of two coefficients and three per multiplication. Shared sub-expressions are
+    counted for each term, so it's an upper bound.
+    */
+    constexpr unsigned cost_of(bexpr expr) {
+
+        switch (expr) {
+            case bexpr::X: case bexpr::Y: case bexpr::ONES: return 0;
+            case bexpr::NOT_X: case bexpr::NOT_Y: case bexpr::AND: case bexpr::OR: case bexpr::XOR: return 1;
+            default: return 2; // a bitwise operation on an inverted operand, or an inverted bitwise operation
+        }
+
+    }
+
+    constexpr unsigned cost_of(int64_t coef) {
+
+        uint64_t coef_abs = coef < 0 ? -static_cast<uint64_t>(coef) : static_cast<uint64_t>(coef);
+
+        if (coef_abs == 1) return 0;
+
+        return (coef_abs & (coef_abs - 1)) == 0 ? 1 : 3;
+
+    }
+
+    constexpr unsigned cost_of(const identity& id) {
+
+        unsigned cost = id.n_terms - 1; // additions combining the terms
+
+        for (size_t i = 0; i < id.n_terms; ++i)
+            cost += cost_of(id.terms[i].expr) + cost_of(id.terms[i].coef);
+
+        return cost;
+
+    }
+
+    /* Whether 'inst' is an add/sub/xor/and/or on i8, i16, i32 or i64 */
+    bool is_rewritable(const llvm::BinaryOperator* inst);
+
+    /* Cycles of XORing both operands with an opaque zero */
+    constexpr unsigned COST_OPAQUE_OPERANDS = 2;
+
+    /*
+    Rewrites 'inst' into a linear MBA form picked randomly among the identities of its opcode
+    which cost at most 'budget' cycles. With the budget left, every other term reads the operands
+    XORed with 'v_opaque_zero', so the optimizer can't match the terms against each other anymore,
+    then an identity summing to zero is mixed in with a random coefficient.
+    The result replaces 'inst', which is erased.
+
+    inst: Binary operator accepted by 'is_rewritable'.
+    budget: Cycles which the rewritten expression may cost.
+    v_opaque_zero: Opaque value of the same type as 'inst' which is zero at runtime, may be null.
+    insts_out: Every instruction inserted for the rewrite.
+
+    Returns false if no identity fits the budget, then nothing is changed.
+    */
+    bool rewrite_binop(
+        llvm::BinaryOperator* inst, unsigned budget, llvm::Value* v_opaque_zero,
+        std::vector<llvm::Instruction*>& insts_out
+        );
+
+}
+
+#endif
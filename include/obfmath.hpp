@@ -4,6 +4,8 @@
 #include "llvm/Pass.h"
 #include "llvm/Passes/PassBuilder.h"
 
+#include "include/emit.hpp"
+
 
 namespace math {
 
@@ -13,20 +15,62 @@ namespace math {
     /*  */
     template <typename T>
     insval_t generate_equation(
-        llvm::Module& mod,
+        emit::context& ectx,
         const std::vector<insval_t>& opaque_vals,
         size_t num_deepness);
 
+    /*
+    Multi-output form of 'generate_equation'. A single random DAG is built on 'opaque_vals', then its last
+    deepness is made of 'num_roots' roots, each one operation on two nodes of the deepness below.
+
+    Returns the instructions of the shared DAG, operands before their users. 'roots_out' gets the
+    instructions and the value of each root, which are placed by the caller anywhere the DAG dominates
+    (e.g. right before the user of the root) and corrected to their targets by a constant.
+    */
+    template <typename T>
+    std::vector<llvm::Value*> generate_equation_roots(
+        emit::context& ectx,
+        const std::vector<insval_t>& opaque_vals,
+        size_t num_deepness,
+        size_t num_roots,
+        std::vector<insval_t>& roots_out);
+
+    /*
+    Appends an equation of three opaque 64-bit values in [MAX_UINT16, MAX_UINT64] to the scratch
+    block of 'ectx', with 'num_deepness' levels. Last value of the result is the root.
+    */
+    insval_t emit_opaque_equation(emit::context& ectx, size_t num_deepness);
+
+    /* Same as 'emit_opaque_equation' with 'num_roots' roots, only the shared DAG is appended */
+    void emit_opaque_roots(emit::context& ectx, size_t num_deepness, size_t num_roots, std::vector<insval_t>& roots_out);
+
     /*
     This function creates a bunch of instructions according to the obfuscation of string
-    given by argument 'str' and return them.
+    given by argument 'str' and appends them to the scratch block of 'ectx'.
+    String is rebuilt in 8-byte words on a stack buffer of 'padded_string_size' bytes, each
+    word from its own root of one equation shared by the string.
 
-    mod: LLVM module.
+    ectx: Emit context of the module, holding its types and constants.
     str: String initializer to be obfuscated.
+    num_deepness: Deepness of the equation generated for the string.
 
-    Note that resulting string is located in last instruction value on returned list.
+    Returns the pointer to the resulting string, which is the last appended instruction.
+    Caller moves the instructions to their place with 'emit::context::splice_before'.
     */
-    std::vector<llvm::Instruction*> obfuscate_string_literal(llvm::Module& mod, llvm::StringRef str);
+    llvm::Value* obfuscate_string_literal(
+        emit::context& ectx, llvm::StringRef str, size_t num_deepness = 30);
+
+    /*
+    Same as 'obfuscate_string_literal', but only a 64-bit seed comes from an opaque equation.
+    Words are XORed with a xorshift64 keystream expanded from the seed in registers, which the
+    host runs as well to encrypt them. Each word costs a few ALU instructions, and every one of
+    them depends on the words before it.
+    */
+    llvm::Value* obfuscate_string_literal_keystream(
+        emit::context& ectx, llvm::StringRef str, size_t num_deepness = 30);
+
+    /* Size of the buffer which a string of 'sz_str' bytes is rebuilt into, rounded up to whole words */
+    size_t padded_string_size(size_t sz_str);
 
 }
 
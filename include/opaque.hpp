@@ -5,23 +5,32 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
 
+#include "include/emit.hpp"
+
 
 namespace opaque {
 
     /*
     Creates a bunch of instructions which creates an opaque value
     using USER_SHARED_DATA and make the result equal to argument passed by 'eq_to' value.
+    On non-Windows targets (or with '-ux-opaque-source=global') a weak global is loaded instead.
 
-    mod: LLVM module.
+    ectx: Emit context of the module, holding its types and constants.
     eq_to: Indicates that what opaque value is going to be equal to after all instructions are executed.
     sz_eq_bits: Size of resulting value in bits (must be one of 8/16/32/64).
 
     Note that resulting value is located in last instruction value on returned list.
     */
     std::vector<llvm::Instruction*> opaque_by_user_shared_data(
-        llvm::Module& mod, uint64_t eq_to, unsigned short sz_eq_bits
+        emit::context& ectx, uint64_t eq_to, unsigned short sz_eq_bits
         );
 
+    /* Whether 'gv' is the global which opaque values are loaded from on non-Windows targets */
+    bool is_opaque_source(const llvm::GlobalValue* gv);
+
+    /* Whether 'inst' is the load of an opaque value, from the weak global or USER_SHARED_DATA */
+    bool is_opaque_load(const emit::context& ectx, const llvm::Instruction* inst);
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef SELECTION_HPP
+#define SELECTION_HPP
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Module.h"
+
+
+namespace selection {
+
+    /* Transforms which a function or global can be selected for (bit flags) */
+    enum kind : unsigned {
+
+        NONE = 0,
+        STRINGS = 1 << 0,
+        REFS = 1 << 1,
+        SPLIT = 1 << 2,
+        BCF = 1 << 3,
+        MBA = 1 << 4,
+        POOL = 1 << 5,
+        CONSTS = 1 << 6,
+        ALL = STRINGS | REFS | SPLIT | BCF | MBA | POOL | CONSTS
+
+    };
+
+    /*
+    Decides which functions and globals are going to be obfuscated. Sources are:
+
+    1. __attribute__((annotate("ux:refs,strings"))) read from 'llvm.global.annotations' ("ux" alone selects all),
+    2. Functions and globals placed in section '._obf_sel' (selects all),
+    3. Allow/deny regex list given by '-ux-select-file', one rule per line:
+
+        allow[:kinds] <regex>
+        deny[:kinds] <regex>
+        # comment
+
+    Callers of '._obf_str' functions are implicitly selected for strings.
+    Deny rules override every other source. If none of the sources selects anything,
+    every function and global which isn't denied is selected, as it was before.
+    */
+    struct selector {
+
+        explicit selector(llvm::Module& mod);
+
+        /* Whether the function or global 'gv' is selected for the transform 'k' */
+        bool is_selected(const llvm::GlobalValue* gv, kind k) const;
+
+        /* Whether the use of 'g' by 'inst' is selected for the transform 'k'. The function containing 'inst'
+            has to be selected and 'g' not denied. Once any global is selected for 'k', only those globals are */
+        bool is_selected(const llvm::Instruction* inst, const llvm::GlobalValue* g, kind k) const;
+
+        /* Number of defined functions and globals selected for the transform 'k' */
+        size_t count_functions(kind k) const;
+        size_t count_globals(kind k) const;
+
+    private:
+
+        llvm::Module& mod;
+
+        bool restricted = false;
+
+        unsigned kinds_by_globals = kind::NONE; /* kinds which some global is explicitly selected for */
+
+        llvm::DenseMap<const llvm::GlobalValue*, unsigned> kinds_selected;
+        llvm::DenseMap<const llvm::GlobalValue*, unsigned> kinds_denied;
+
+    };
+
+    /* Parses a comma separated list of transform names ("refs,strings") into kind flags.
+        Returns false if an unknown name is found */
+    bool parse_kinds(llvm::StringRef str_kinds, unsigned& kinds_out);
+
+}
+
+#endif
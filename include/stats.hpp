@@ -0,0 +1,82 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Module.h"
+
+
+namespace stats {
+
+    /* Instruction and block counts of a function */
+    struct function_size {
+        unsigned n_instructions = 0;
+        unsigned n_blocks = 0;
+    };
+
+    /* Whether transforms are recorded: statistics, the JSON summary ('-ux-stats-json') or info logs are on.
+        Snapshots and their diff are skipped otherwise, so instrumentation costs nothing when it's off */
+    bool is_enabled();
+
+    /* Sizes of every defined function of a module, taken before a transform runs */
+    typedef llvm::StringMap<function_size> module_snapshot_t;
+
+    void take_snapshot(llvm::Module& mod, module_snapshot_t& snapshot_out);
+
+    /* Summary of a single transform run */
+    struct transform_record {
+        std::string pass_name;
+        size_t n_fn_selected = 0;
+        size_t n_g_selected = 0;
+        double time_ms = 0;
+    };
+
+    /*
+    Records how much the module has grown since 'before' was taken, updates the statistics
+    (instructions/blocks added) and adds it to the JSON summary given by '-ux-stats-json',
+    which is written once the process exits.
+
+    Summary is cumulative for all transforms run on the process, with per-function added instruction counts
+    and the peak resident set size of the process once the transform is done:
+
+        { "transforms": [ { "pass": "ux-refs", "time_ms": 1.2, "functions_selected": 3, "globals_selected": 2,
+            "instructions_added": 120, "blocks_added": 0, "peak_rss_kb": 81920, "functions": { "main": 80, ... } }, ... ] }
+    */
+    void record_transform(llvm::Module& mod, const module_snapshot_t& before, const transform_record& record);
+
+    /* Peak resident set size of the process in KiB, zero if the platform doesn't report it */
+    uint64_t peak_rss_kb();
+
+    /* How many instructions tagged by a transform are left, against the count once obfuscation ended */
+    struct survival_record {
+        std::string pass_name;
+        uint64_t n_emitted = 0;
+        uint64_t n_surviving = 0;
+    };
+
+    /*
+    Prints the survival of every transform and adds it to the JSON summary as:
+
+        "survival": [ { "pass": "ux-strings", "emitted": 1200, "surviving": 1100, "ratio": 0.91 }, ... ]
+    */
+    void record_survival(const std::vector<survival_record>& records);
+
+    /* Work a transform skipped or downgraded in a function since its growth budget ran out */
+    struct budget_record {
+        std::string fn_name;
+        uint64_t n_limit = 0;
+        uint64_t n_spent = 0;
+        uint64_t n_skipped = 0;
+        uint64_t n_downgraded = 0;
+    };
+
+    /*
+    Adds the functions whose budget ran out during 'pass_name' to the JSON summary as:
+
+        "budget": [ { "pass": "ux-refs", "skipped": 12, "downgraded": 0, "functions": {
+            "main": { "limit": 40, "spent": 38, "skipped": 12, "downgraded": 0 }, ... } }, ... ]
+    */
+    void record_budget(llvm::StringRef pass_name, const std::vector<budget_record>& records);
+
+}
+
+#endif
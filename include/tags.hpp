@@ -0,0 +1,46 @@
+#ifndef TAGS_HPP
+#define TAGS_HPP
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+
+
+namespace tags {
+
+    /* Instruction metadata holding the name of the transform which generated it: !ux.obf !{!"ux-refs"} */
+    constexpr const char* MD_OBF = "ux.obf";
+
+    /* Named module metadata holding the number of tagged instructions per transform, once obfuscation ends */
+    constexpr const char* MD_EMITTED = "ux.obf.emitted";
+
+    typedef llvm::StringMap<uint64_t> tag_counts_t;
+
+    /* Tags 'inst' as generated by 'transform', an existing tag is kept */
+    void mark(llvm::Instruction* inst, llvm::StringRef transform);
+
+    template <typename range_t>
+    void mark_all(const range_t& insts, llvm::StringRef transform) {
+
+        for (auto* inst : insts)
+            mark(llvm::cast<llvm::Instruction>(inst), transform);
+
+    }
+
+    /* Copies the tag of 'inst_from' to 'inst_to', if there is one */
+    void copy_mark(const llvm::Instruction* inst_from, llvm::Instruction* inst_to);
+
+    /* Name of the transform which generated 'inst', empty if it isn't tagged */
+    llvm::StringRef get_mark(const llvm::Instruction* inst);
+
+    /* Counts the tagged instructions of every defined function per transform */
+    void count_marks(llvm::Module& mod, tag_counts_t& counts_out);
+
+    /* Replaces the counts kept in MD_EMITTED, so later pipelines can tell how much obfuscation survived */
+    void set_emitted(llvm::Module& mod, const tag_counts_t& counts);
+
+    void get_emitted(llvm::Module& mod, tag_counts_t& counts_out);
+
+}
+
+#endif
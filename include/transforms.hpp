@@ -0,0 +1,116 @@
+#ifndef TRANSFORMS_HPP
+#define TRANSFORMS_HPP
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+
+#include "include/selection.hpp"
+
+
+namespace transforms {
+
+    /* Decides how obfuscated string literals are materialized at runtime */
+    enum class strings_mode {
+
+        INLINE, /* rebuilt on stack at each _obf_str call site by opaque equations */
+        STARTUP, /* XOR-encoded in place and decoded once on entry of 'main' */
+        SHARED /* rebuilt by a linkonce_odr decoder per literal, deduplicated across modules (ThinLTO) */
+
+    };
+
+    /* Decides how a string rebuilt by INLINE or SHARED mode is encrypted */
+    enum class strings_encoding {
+
+        EQUATIONS, /* each 8-byte word is XORed with its own root of an opaque equation shared by the string */
+        KEYSTREAM /* one opaque equation seeds a xorshift64 keystream XORed with every word */
+
+    };
+
+    struct strings_options {
+        strings_mode mode = strings_mode::INLINE;
+        strings_encoding encoding = strings_encoding::EQUATIONS;
+        size_t depth = 30; /* deepness of the equation generated per string, or per seed */
+    };
+
+    struct refs_options {
+        size_t depth = 5; /* deepness of the equation generated per global reference */
+    };
+
+    struct split_options {
+        unsigned short times = 2; /* how many times blocks of each function are split */
+    };
+
+    struct bcf_options {
+        unsigned short times = 2; /* passed through 'times_repeat' of ir_manager::function::bogus_control_flow */
+    };
+
+    struct mba_options {
+        unsigned budget = 8; /* cycles which a single rewritten operation may cost, see mba::cost_of */
+    };
+
+    struct consts_options {
+        size_t depth = 10; /* deepness of the equation generated per function, shared by all of its constants */
+    };
+
+    struct pool_options {
+        size_t depth = 30; /* deepness of the equation generating the seed of the pool */
+    };
+
+    /*
+    Collects every call to functions placed in section '._obf_str' together with
+    the string literal passed as its first argument.
+
+    mod: LLVM module.
+    sel: Selection of functions, calls inside non-selected functions are skipped.
+    calls_out: List of (call, literal) pairs, nothing is mutated while collecting.
+    */
+    void collect_obf_str_calls(
+        llvm::Module& mod, const selection::selector& sel,
+        std::vector<std::pair<llvm::CallInst*, llvm::GlobalVariable*>>& calls_out
+        );
+
+    /* Replaces each _obf_str call with the string rebuilt by opaque equations (strings_mode::INLINE),
+        or with a call to the shared decoder of its literal '__ux_str.<hash>' (strings_mode::SHARED),
+        or encodes the literals and decodes them on entry of 'main' (strings_mode::STARTUP) */
+    bool obfuscate_string_literals(llvm::Module& mod, const selection::selector& sel, const strings_options& opts);
+
+    /* Hides every selected instruction reference to a global behind an offset which is removed in opaque form */
+    bool obfuscate_references(llvm::Module& mod, const selection::selector& sel, const refs_options& opts);
+
+    /* Splits the blocks of every selected function 'opts.times' times */
+    bool split_blocks(llvm::Module& mod, const selection::selector& sel, const split_options& opts);
+
+    /* Bogus the control flow of every selected function */
+    bool bogus_control_flow(llvm::Module& mod, const selection::selector& sel, const bcf_options& opts);
+
+    /*
+    Rewrites 'inttoptr(add/sub(ptrtoint P, X))' round trips left by strings and refs into 'getelementptr i8, P, X'
+    (or '-X'), in functions selected for either. Opaque offsets stay in place, but the pointer keeps
+    the provenance of P, so alias analysis no longer treats it as escaped.
+    Only round trips tagged by a transform are rewritten, the ones of user code may point into another object.
+    */
+    bool canonicalize_pointer_arithmetic(llvm::Module& mod, const selection::selector& sel);
+
+    /* Rewrites add/sub/xor/and/or of user code in every selected function into linear MBA forms
+        within 'opts.budget', instructions generated by other transforms are left alone */
+    bool rewrite_mba(llvm::Module& mod, const selection::selector& sel, const mba_options& opts);
+
+    /*
+    Moves every selected internal constant aggregate (tables, keys, structs of integers and floats, but not
+    C strings and nothing holding an address) into a single encrypted pool '__ux_pool'. Uses of each global
+    are replaced with its offset in the pool, and a constructor running before the user's ones decodes the
+    pool in place in one pass over its words, so accesses cost nothing more after startup.
+    */
+    bool encrypt_constant_pool(llvm::Module& mod, const selection::selector& sel, const pool_options& opts);
+
+    /*
+    Replaces integer constants used by arithmetic, comparisons, selects, stores, returns and calls in every
+    selected function with roots of one opaque equation per function, computed on its entry. Operands
+    which must stay immediate (GEP struct indices, switch cases, 'immarg' and intrinsic arguments, PHIs,
+    allocas) and divisors are left alone.
+    */
+    bool obfuscate_constants(llvm::Module& mod, const selection::selector& sel, const consts_options& opts);
+
+}
+
+#endif
@@ -1,6 +1,27 @@
-#define LOG_OK(str) (errs() << std::string("\033[36m[LOG]: ") + str + "\033[0m\n")
-#define LOG_WARN(str) (errs() << std::string("\033[33m[WARNING]: ") + str + "\033[0m\n")
-#define LOG_ERROR(str) (errs() << std::string("\033[31m[ERROR]: ") + str + "\033[0m\n")
-#define LOG_SUCCESS(str) (errs() << std::string("\033[32m[SUCCESS]: ") + str + "\033[0m\n")
+#ifndef UX_OBF_UTILS_H
+#define UX_OBF_UTILS_H
 
-#define IN_RANGE(x, min, max) (x >= min && x <= max)
\ No newline at end of file
+/* Logging levels, each level includes the ones below it */
+enum LOG_LEVEL {
+
+    LOG_LEVEL_NONE,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO
+
+};
+
+/* Set through '-ux-log-level', defined in stats.cpp */
+extern unsigned ux_log_level;
+
+/* Message is only built if its level is enabled, so disabled logs cost nothing but a comparison */
+#define LOG_IF(level, prefix, str) do { if (ux_log_level >= level) (errs() << std::string(prefix) + str + "\033[0m\n"); } while (0)
+
+#define LOG_OK(str) LOG_IF(LOG_LEVEL_INFO, "\033[36m[LOG]: ", str)
+#define LOG_WARN(str) LOG_IF(LOG_LEVEL_WARN, "\033[33m[WARNING]: ", str)
+#define LOG_ERROR(str) LOG_IF(LOG_LEVEL_ERROR, "\033[31m[ERROR]: ", str)
+#define LOG_SUCCESS(str) LOG_IF(LOG_LEVEL_INFO, "\033[32m[SUCCESS]: ", str)
+
+#define IN_RANGE(x, min, max) (x >= min && x <= max)
+
+#endif
@@ -8,11 +8,38 @@
 #define UNUSED(x) ((void)x)
 
 
+/* Engine behind 'gen_random_int', seeded from the system unless a 'random_seed_scope' is alive */
+inline std::mt19937_64& random_engine() {
+
+    thread_local std::mt19937_64 rng(std::random_device{}());
+
+    return rng;
+
+}
+
+/*
+Makes every random number drawn while it's alive a function of 'seed', so the same input emits
+the same IR on every translation unit (required for linkonce_odr bodies). Engine is reseeded
+from the system once the scope ends.
+*/
+class random_seed_scope {
+
+public:
+
+    explicit random_seed_scope(uint64_t seed) { random_engine().seed(seed); }
+
+    ~random_seed_scope() { random_engine().seed(std::random_device{}()); }
+
+    random_seed_scope(const random_seed_scope&) = delete;
+    random_seed_scope& operator=(const random_seed_scope&) = delete;
+
+};
+
+
 template <typename T>
 inline T gen_random_int(T range_start, T range_end) {
 
-    std::random_device dev;
-    std::mt19937_64 rng(dev());
+    std::mt19937_64& rng = random_engine();
 
     std::uniform_int_distribution<std::mt19937_64::result_type> dist(range_start, range_end);
 
@@ -23,8 +50,7 @@ inline T gen_random_int(T range_start, T range_end) {
 template <typename T, size_t _N>
 inline std::vector<T> gen_random_int(T range_start, T range_end) {
 
-    std::random_device dev;
-    std::mt19937_64 rng(dev());
+    std::mt19937_64& rng = random_engine();
 
     std::vector<size_t> nums(range_end - range_start + 1);
     std::iota(nums.begin(), nums.end(), range_start);
@@ -41,25 +67,14 @@ inline std::vector<T> gen_random_int(T range_start, T range_end) {
 template <typename T>
 inline llvm::IntegerType* decide_integer_type(llvm::LLVMContext& ctx) {
 
-    llvm::IntegerType* ty_val = nullptr;
-    constexpr size_t sz_type = sizeof(T);
-    switch (sz_type) {
-        case 8:
-            ty_val = llvm::Type::getInt64Ty(ctx);
-            break;
-        case 4:
-            ty_val = llvm::Type::getInt32Ty(ctx);
-            break;
-        case 2:
-            ty_val = llvm::Type::getInt16Ty(ctx);
-            break;
-        case 1:
-            ty_val = llvm::Type::getInt8Ty(ctx);
-            break;
+    if constexpr (sizeof(T) == 1) return llvm::Type::getInt8Ty(ctx);
+    else if constexpr (sizeof(T) == 2) return llvm::Type::getInt16Ty(ctx);
+    else if constexpr (sizeof(T) == 4) return llvm::Type::getInt32Ty(ctx);
+    else {
+        static_assert(sizeof(T) == 8, "Integer type must be 8, 16, 32 or 64 bits wide.");
+        return llvm::Type::getInt64Ty(ctx);
     }
 
-    return ty_val;
-
 }
 
 
@@ -0,0 +1,180 @@
+#include "include/budget.hpp"
+#include "include/stats.hpp"
+#include "include/utils.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/CommandLine.h"
+
+#define DEBUG_TYPE "ux-obfuscator"
+
+using namespace llvm;
+
+
+STATISTIC(NumBudgetSkipped, "Number of obfuscation items skipped since the growth budget of their function ran out");
+STATISTIC(NumBudgetDowngraded, "Number of obfuscation items done in a cheaper form to fit the growth budget of their function");
+
+static cl::opt<unsigned> BudgetPercent(
+    "ux-budget",
+    cl::desc("Percent of its size before obfuscation which every function may grow by, shared by all transforms "
+        "(0: unlimited)"),
+    cl::init(0));
+
+static cl::opt<unsigned> BudgetMin(
+    "ux-budget-min",
+    cl::desc("Instructions which every function may grow by at least, whatever its size, when '-ux-budget' is given"),
+    cl::init(64));
+
+
+namespace budget {
+
+    namespace {
+
+        /* Percent of the budget a transform may spend, higher priority transforms get a larger share */
+        unsigned share_of(selection::kind k) {
+
+            switch (k) {
+                case selection::kind::STRINGS: return 100; // left alone, the literal is in plain text
+                case selection::kind::REFS: return 90;
+                case selection::kind::CONSTS: return 75;
+                case selection::kind::MBA: return 60;
+                case selection::kind::BCF: return 50;
+                case selection::kind::SPLIT: return 40;
+                default: return 100;
+            }
+
+        }
+
+        /* Size of 'fn' before obfuscation, it's kept on the function the first time it's asked for */
+        uint64_t get_base_size(Function& fn) {
+
+            if (MDNode* md_budget = fn.getMetadata(MD_BUDGET)) {
+
+                ConstantAsMetadata* md_size = md_budget->getNumOperands() == 1
+                    ? dyn_cast<ConstantAsMetadata>(md_budget->getOperand(0)) : nullptr;
+
+                if (ConstantInt* c_size = md_size ? dyn_cast<ConstantInt>(md_size->getValue()) : nullptr)
+                    return c_size->getZExtValue();
+
+            }
+
+            LLVMContext& ctx = fn.getContext();
+
+            uint64_t n_size = fn.getInstructionCount();
+
+            fn.setMetadata(MD_BUDGET, MDNode::get(ctx,
+                ConstantAsMetadata::get(ConstantInt::get(Type::getInt64Ty(ctx), n_size))));
+
+            return n_size;
+
+        }
+
+    }
+
+    tracker::tracker(selection::kind k, StringRef pass_name) : pass_name(pass_name.str()), share(share_of(k)) {}
+
+    bool tracker::is_enabled() const {
+
+        return BudgetPercent > 0;
+
+    }
+
+    tracker::function_state& tracker::get_state(Function& fn) {
+
+        auto [it_state, inserted] = states.insert({ &fn, function_state() });
+
+        function_state& state = it_state->second;
+
+        if (!inserted) return state;
+
+        uint64_t n_base = get_base_size(fn);
+        uint64_t n_size = fn.getInstructionCount();
+
+        uint64_t n_total = std::max<uint64_t>(n_base * BudgetPercent / 100, BudgetMin);
+
+        state.n_limit = n_total * share / 100;
+        state.n_spent = n_size > n_base ? n_size - n_base : 0;
+
+        return state;
+
+    }
+
+    size_t tracker::remaining(Function& fn) {
+
+        if (!is_enabled()) return SIZE_MAX;
+
+        function_state& state = get_state(fn);
+
+        return state.n_limit > state.n_spent ? state.n_limit - state.n_spent : 0;
+
+    }
+
+    bool tracker::try_spend(Function& fn, size_t n_insts) {
+
+        if (!is_enabled()) return true;
+
+        if (remaining(fn) < n_insts) return false;
+
+        get_state(fn).n_spent += n_insts;
+
+        return true;
+
+    }
+
+    void tracker::charge(Function& fn, size_t n_insts) {
+
+        if (!is_enabled()) return;
+
+        get_state(fn).n_spent += n_insts;
+
+    }
+
+    void tracker::skip(Function& fn, size_t n_items) {
+
+        get_state(fn).n_skipped += n_items;
+
+        NumBudgetSkipped += n_items;
+
+    }
+
+    void tracker::downgrade(Function& fn, size_t n_items) {
+
+        get_state(fn).n_downgraded += n_items;
+
+        NumBudgetDowngraded += n_items;
+
+    }
+
+    void tracker::report() const {
+
+        std::vector<stats::budget_record> records = {};
+
+        size_t n_skipped = 0;
+        size_t n_downgraded = 0;
+
+        for (auto& [fn, state] : states) {
+
+            if (!state.n_skipped && !state.n_downgraded) continue;
+
+            LOG_OK("[" + pass_name + "]: Budget of function (" + fn->getName() + ") ran out at "
+                + std::to_string(state.n_spent) + " of " + std::to_string(state.n_limit) + " instruction(s), skipped "
+                + std::to_string(state.n_skipped) + " and downgraded " + std::to_string(state.n_downgraded) + " item(s).");
+
+            records.push_back({ fn->getName().str(), state.n_limit, state.n_spent, state.n_skipped, state.n_downgraded });
+
+            n_skipped += state.n_skipped;
+            n_downgraded += state.n_downgraded;
+
+        }
+
+        if (records.empty()) return;
+
+        LOG_WARN("[" + pass_name + "]: Growth budget ran out in " + std::to_string(records.size()) + " function(s), skipped "
+            + std::to_string(n_skipped) + " and downgraded " + std::to_string(n_downgraded) + " item(s).");
+
+        stats::record_budget(pass_name, records);
+
+    }
+
+}
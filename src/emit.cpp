@@ -0,0 +1,65 @@
+#include "include/emit.hpp"
+#include "include/opaque.hpp"
+#include "include/tags.hpp"
+
+#include "llvm/ADT/Statistic.h"
+
+#define DEBUG_TYPE "ux-obfuscator"
+
+using namespace llvm;
+
+
+// Counted once spliced, since chains of unused equation slots or discarded emits never reach the function
+STATISTIC(NumOpaqueLoadsEmitted, "Number of opaque loads emitted");
+
+
+namespace emit {
+
+    context::~context() {
+
+        // Left only if a transform bailed out after emitting, nothing refers to those instructions then
+        discard();
+
+        delete bl_scratch;
+
+    }
+
+    void context::append(ArrayRef<Value*> insts) {
+
+        for (Value* val : insts)
+            append(cast<Instruction>(val));
+
+    }
+
+    void context::append(ArrayRef<Instruction*> insts) {
+
+        for (Instruction* inst : insts)
+            append(inst);
+
+    }
+
+    void context::splice_before(Instruction* inst_pos, StringRef transform) {
+
+        for (Instruction& inst : *bl_scratch) {
+
+            tags::mark(&inst, transform);
+
+            if (opaque::is_opaque_load(*this, &inst)) NumOpaqueLoadsEmitted++;
+
+        }
+
+        inst_pos->getParent()->splice(inst_pos->getIterator(), bl_scratch);
+
+    }
+
+    void context::discard() {
+
+        for (Instruction& inst : *bl_scratch)
+            inst.dropAllReferences();
+
+        while (!bl_scratch->empty())
+            bl_scratch->back().eraseFromParent();
+
+    }
+
+}
@@ -29,674 +29,658 @@
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/IR/PassTimingInfo.h"
 #include <llvm/CodeGen/MachineFunctionPass.h>
 #include <llvm/CodeGen/MachinePassManager.h>
 #include <llvm/CodeGen/MachineBasicBlock.h>
 #include <llvm/CodeGen/MachineInstrBuilder.h>
 #include <llvm/CodeGen/TargetSubtargetInfo.h>
 #include <llvm/CodeGen/TargetInstrInfo.h>
+#include <llvm/CodeGen/TargetPassConfig.h>
+#include <llvm/CodeGen/Passes.h>
+#include <llvm/Target/RegisterTargetPassConfigCallback.h>
+#include <llvm/Target/TargetMachine.h>
 #include "X86InstrInfo.inc"
 
-#include "include/encoder.h"
-#include "include/irmanager.h"
-#include "include/obfmath.hpp"
-#include "include/opaque.hpp"
+#include "include/stats.hpp"
+#include "include/tags.hpp"
+#include "include/transforms.hpp"
+#include "include/utils.h"
 
+#include <chrono>
 
-using namespace llvm;
-
-
-namespace {
 
-std::vector<GlobalVariable*> encode_string_literals(Module &mod) {
-    
-    std::vector<GlobalVariable*> g_strings = {};
-
-    // First get string globals
-
-    auto globals = mod.globals();
+using namespace llvm;
 
-    for (GlobalVariable& _g : globals) {
 
-        if (!_g.hasInitializer()) continue; // means global doesn't have an initializer
+static cl::opt<bool> MIRInPipeline(
+	"wv-mir-in-pipeline",
+	cl::desc("Insert the WareVisor MIR pass into the codegen pipeline right after instruction selection"),
+	cl::init(true));
 
-        Constant* val_init = _g.getInitializer();
 
-        if (isa<ConstantDataArray>(val_init)) {
+namespace {
 
-            auto const_data_arr = cast<ConstantDataArray>(val_init);
-            if (!const_data_arr->isString()) continue;
+/* Runs 'transform' with the selection of the module inside a timed region, so it shows up on
+	'-time-passes' and '-ftime-trace', and records how much the module has grown through it when stats are on */
+template <typename transform_cb_t>
+PreservedAnalyses run_transform(Module& M, StringRef pass_name, selection::kind k, transform_cb_t transform) {
 
-            // Then this value is exactly what we need
+	TimeTraceScope time_scope("UXTransform", pass_name);
 
-            StringRef str_ref_data = const_data_arr->getAsString();
+	selection::selector sel(M);
 
-            const char* data = str_ref_data.begin();
-            const int sz_data = str_ref_data.size();
+	bool record_stats = stats::is_enabled();
 
-            char* str_encoded = new char[sz_data];
-            encoder::encode_c_string(data, str_encoded, 0xAF, sz_data);
+	stats::transform_record record = {};
+	record.pass_name = pass_name.str();
 
-            Constant* const_encoded = ConstantDataArray::getString(mod.getContext(), StringRef(str_encoded, sz_data), 0);
+	stats::module_snapshot_t snapshot = {};
 
-            _g.setInitializer(const_encoded);
-            g_strings.push_back(&_g);
-            _g.setConstant(false /* not constant */);
+	if (record_stats) {
 
-        }
+		record.n_fn_selected = sel.count_functions(k);
+		record.n_g_selected = sel.count_globals(k);
 
-    }
+		stats::take_snapshot(M, snapshot);
 
-    return g_strings;
+	}
 
-}
+	bool changed = false;
 
-void obfuscate_string_literals(Module& mod) {
+	{
 
-	auto& ctx = mod.getContext();
+		NamedRegionTimer timer(pass_name, pass_name, "ux", "UX Obfuscator Transforms", TimePassesIsEnabled);
 
-    std::vector<GlobalVariable*> g_strings = {};
+		auto tm_start = std::chrono::steady_clock::now();
 
-	// Get string globals
+		changed = transform(sel);
 
-	auto globals = mod.globals();
+		record.time_ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - tm_start).count();
 
-	for (auto& g_var : globals) {
+	}
 
-		Constant* init = g_var.getInitializer();
+	if (record_stats) stats::record_transform(M, snapshot, record);
 
-		// Check if global is not a string
+	if (changed) {
 
-		if (!isa<ConstantDataArray>(init)) continue;
+		// Counts are kept on the module, so a later 'ux-survival' can tell how many were optimized away
+		tags::tag_counts_t counts = {};
+		tags::count_marks(M, counts);
+		tags::set_emitted(M, counts);
 
-		ConstantDataArray* cdarr_init = cast<ConstantDataArray>(init);
+	}
 
-		if (!cdarr_init->isString()) continue;
+	if (!changed)
+		return PreservedAnalyses::all();
+	return PreservedAnalyses::none();
 
-		// Now we are sure that we have a string-like global
+}
 
-		// OP_1: Remove access to the global string on its use with _obf_str function.
-		// OP_2: Remove the global string permanently.
-		// COND_OP_2: Global string shouldn't conflict with standart uses.
-		// For example if there's a _obf_str("hello") and also is a printf("hello")
-		// On that circumstance, we can't gremove the global string because it's used on its deobfuscation form as well. 
+struct StringsPass : PassInfoMixin<StringsPass> {
+    transforms::strings_options opts;
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-strings", selection::kind::STRINGS, [&](const selection::selector& sel) {
+            return transforms::obfuscate_string_literals(M, sel, opts);
+        });
+    }
+};
 
-		/*
-		
-			%str = call _obf_str... [ Convert this line... ]
+struct ReferencesPass : PassInfoMixin<ReferencesPass> {
+    transforms::refs_options opts;
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-refs", selection::kind::REFS, [&](const selection::selector& sel) {
+            return transforms::obfuscate_references(M, sel, opts);
+        });
+    }
+};
 
-			to:
+struct SplitPass : PassInfoMixin<SplitPass> {
+    transforms::split_options opts;
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-split", selection::kind::SPLIT, [&](const selection::selector& sel) {
+            return transforms::split_blocks(M, sel, opts);
+        });
+    }
+};
 
-			%str = alloca i8, i8 SZ_CDARR
-			
-			%str.bt.1 = alloca i32
-			store i32 CONST, i32* %str.bt.1
-			...
-			%str.bt.<n> = alloca i32
-			store i32 CONST, i32* %str.bt.<n>
+struct BogusControlFlowPass : PassInfoMixin<BogusControlFlowPass> {
+    transforms::bcf_options opts;
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-bcf", selection::kind::BCF, [&](const selection::selector& sel) {
+            return transforms::bogus_control_flow(M, sel, opts);
+        });
+    }
+};
 
-			< chain of math operations hidden with opaque predicating >
+struct MBAPass : PassInfoMixin<MBAPass> {
+    transforms::mba_options opts;
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-mba", selection::kind::MBA, [&](const selection::selector& sel) {
+            return transforms::rewrite_mba(M, sel, opts);
+        });
+    }
+};
 
-		*/
+struct ConstantsPass : PassInfoMixin<ConstantsPass> {
+    transforms::consts_options opts;
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-consts", selection::kind::CONSTS, [&](const selection::selector& sel) {
+            return transforms::obfuscate_constants(M, sel, opts);
+        });
+    }
+};
 
-		bool used_non_obf = false;
+struct PoolPass : PassInfoMixin<PoolPass> {
+    transforms::pool_options opts;
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-pool", selection::kind::POOL, [&](const selection::selector& sel) {
+            return transforms::encrypt_constant_pool(M, sel, opts);
+        });
+    }
+};
 
-		for (size_t i = 0; i < g_var.getNumUses(); ++i) {
+struct CleanupPass : PassInfoMixin<CleanupPass> {
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
+        return run_transform(M, "ux-cleanup", selection::kind::ALL, [&](const selection::selector& sel) {
+            return transforms::canonicalize_pointer_arithmetic(M, sel);
+        });
+    }
+};
 
-			Use* g_var_use = &(*g_var.use_begin()) + i;
+/* Reports how many instructions tagged with !ux.obf are left, e.g. after 'default<O2>' */
+struct SurvivalPass : PassInfoMixin<SurvivalPass> {
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
 
-			User* g_var_user = g_var_use->getUser();
+        tags::tag_counts_t emitted = {};
+        tags::get_emitted(M, emitted);
 
-			if (!isa<Instruction>(g_var_user)) {
-				
-				used_non_obf = true;
+        if (emitted.empty()) {
+            LOG_WARN("No obfuscation transform has run on the module, survival can't be measured.");
+            return PreservedAnalyses::all();
+        }
 
-				continue;
+        tags::tag_counts_t surviving = {};
+        tags::count_marks(M, surviving);
 
-			}
+        std::vector<stats::survival_record> records = {};
 
-			Instruction* instr_user = cast<Instruction>(g_var_user);
+        for (auto& entry : emitted)
+            records.push_back({ entry.getKey().str(), entry.getValue(), surviving.lookup(entry.getKey()) });
 
-			if (instr_user->getOpcode() != Instruction::Call) {
+        llvm::sort(records, [](const stats::survival_record& a, const stats::survival_record& b) {
+            return a.pass_name < b.pass_name;
+        });
 
-				used_non_obf = true;
+        stats::record_survival(records);
 
-				continue;
+        return PreservedAnalyses::all();
 
-			}
+    }
+};
 
-			CallInst* instr_call = cast<CallInst>(instr_user);
+class MIRPass : public MachineFunctionPass {
 
-			Function* callee = instr_call->getCalledFunction();
+public:
 
-			if (callee->getSection() != "._obf_str") {
+	static char ID;
 
-				used_non_obf = true;
-				
-				continue;
+	MIRPass() : MachineFunctionPass(ID) {
 
-			}
+		// InitX86MCInstrInfo(&x86_ii); // init x86 instruction set
 
-			StringRef str_init = cdarr_init->getAsString();
+	}
 
-			auto obf_itrs = math::obfuscate_string_literal(mod, str_init);
+	bool runOnMachineFunction(MachineFunction &MF) override {
 
-			for (Instruction* instr : obf_itrs) {
+		const TargetInstrInfo* x86_tii = MF.getSubtarget().getInstrInfo();
 
-				instr->insertBefore(instr_user);
+		MachineRegisterInfo& x86_mri = MF.getRegInfo();
 
-			}
+		bool changed = false;
 
-			instr_user->replaceAllUsesWith(*(obf_itrs.end() - 1));
+		LOG_OK("Running on function: " + MF.getName());
 
-			instr_user->eraseFromParent();
+		for (auto it_bbl = MF.begin(); it_bbl != MF.end(); ++it_bbl) {
 
-		}
+			MachineBasicBlock& bbl = *it_bbl;
 
-	}
-    
-}
+			for (auto it_inst = bbl.begin(); it_inst != bbl.end(); ++it_inst) {
 
-void obfuscate_references(Module& mod) {
+				MachineInstr& inst = *it_inst;
 
-	auto& ctx = mod.getContext();
+				if (inst.getOpcode() == X86::MOV64ri) {
 
-	IntegerType* ty_i8 = Type::getInt8Ty(ctx);
-	IntegerType* ty_i32 = Type::getInt32Ty(ctx);
-	IntegerType* ty_i64 = Type::getInt64Ty(ctx);
+					MachineOperand& op_base = inst.getOperand(1);
 
-	auto globs = mod.globals();
+					if (!op_base.isGlobal()) continue;
 
-	for (auto& glob : globs) {
+					/* getOperand(0) yields the return vreg */
+					Register reg_addr = inst.getOperand(0).getReg();
 
-		for (User::user_iterator g_users = glob.user_begin(); g_users != glob.user_end(); ++g_users) {
+					bool reg_not_used = true;
 
-			User* g_user = *g_users;
+					auto n_it_inst = it_inst;
+					for (++n_it_inst; n_it_inst != bbl.end(); ++n_it_inst) {
 
-			if (!isa<Instruction>(g_user)) continue;
+						MachineInstr& n_inst = *n_it_inst;
 
-			Instruction* inst_user = reinterpret_cast<Instruction*>(g_user);
+						if (n_inst.modifiesRegister(reg_addr, nullptr)) break;
 
-			Instruction* inst_base = GetElementPtrInst::Create(
-				ty_i8, &glob,ConstantInt::get(ty_i32, 0x123456),
-				"", inst_user);
+						if (n_inst.readsRegister(reg_addr, nullptr)) {
 
-			std::vector<Instruction*> ins_opq_1 =
-				opaque::opaque_by_user_shared_data(mod, 0x100000, 32);
+							// If pattern matches, then it's not considered a use
+							if (n_inst.getOpcode() == X86::ADD64ri32) {
 
-			math::insval_t insv_opq_1 = { std::vector<Value*>(
-				ins_opq_1.begin(), ins_opq_1.end()
-			), 0x100000 };
+								MachineOperand& op_dest = n_inst.getOperand(1);
+								MachineOperand& op_offset = n_inst.getOperand(2);
 
-			std::vector<Instruction*> ins_opq_2 =
-				opaque::opaque_by_user_shared_data(mod, 0xFFFFFF, 32);
+								if (!op_dest.isReg()
+									|| op_dest.getReg() != reg_addr
+									|| !op_offset.isImm()) continue;
 
-			math::insval_t insv_opq_2 = { std::vector<Value*>(
-				ins_opq_2.begin(), ins_opq_2.end()
-			), 0xFFFFFF };
+								int64_t op_offset_i = op_offset.getImm();
 
-			math::insval_t insv_eq = math::generate_equation<uint32_t>(
-				mod, { insv_opq_1, insv_opq_2 }, 5);
-			auto& v_ins_eq = insv_eq.first;
+								MIMetadata mi_md = MIMetadata(DebugLoc());
 
-			uint32_t gap = 0x123456 - (uint32_t)insv_eq.second;
-			Value* val_gap = ConstantInt::get(ty_i32, gap);
+								const MCInstrDesc& mc_idesc = x86_tii->get(X86::LEA64r);
 
-			Instruction* inst_add_gap =
-				BinaryOperator::CreateAdd(*(v_ins_eq.end() - 1), val_gap);
+								// errs() << "Constraints: " << mc_idesc.operands()[0].Constraints << "\n";
 
-			// inst_add_gap == 0x123456
+								Register reg_use = n_inst.getOperand(0).getReg();
 
-			Instruction* inst_ptr_to_int = new PtrToIntInst(inst_base, ty_i64);
+								// MachineInstr* mi_lea = BuildMI(
+									// bbl,
+									// it_inst,
+									// mi_md,
+									// mc_idesc,
+									// reg_use)
+									// .addGlobalAddress(op_base.getGlobal(), op_offset.getImm());
 
-			Instruction* inst_zext_to_i64 = new ZExtInst(inst_add_gap, ty_i64);
+								// First, remove all operands except the def
+								while (n_inst.getNumOperands() > 1) {
+									n_inst.removeOperand(1);
+								}
 
-			Instruction* inst_sub_gap =
-				BinaryOperator::CreateSub(inst_ptr_to_int, inst_zext_to_i64);
+								n_inst.setDesc(mc_idesc);
 
-			Instruction* inst_ptr_new =
-				new IntToPtrInst(inst_sub_gap, ty_i64->getPointerTo());
+								n_inst.addOperand(MachineOperand::CreateReg(X86::RIP, false)); // base
 
-			std::vector<Instruction*> v_ins_eq_next = {
-				inst_add_gap, inst_ptr_to_int, inst_zext_to_i64,
-				inst_sub_gap, inst_ptr_new
-			};
+								n_inst.addOperand(MachineOperand::CreateImm(1)); // scale
 
-			v_ins_eq.insert(
-				v_ins_eq.end(),
-				reinterpret_cast<Instruction**>(&*v_ins_eq_next.begin()),
-				reinterpret_cast<Instruction**>(&*v_ins_eq_next.end()));
+								n_inst.addOperand(MachineOperand::CreateReg(X86::NoRegister, false)); // index
 
+								n_inst.addOperand(
+									MachineOperand::CreateGA(
+										op_base.getGlobal(),
+										op_offset_i)); // disp
 
-			for (Value* val_inst_eq : v_ins_eq) {
+								n_inst.addOperand(MachineOperand::CreateReg(X86::NoRegister, false)); // seg
 
-				Instruction* inst_eq = reinterpret_cast<Instruction*>(val_inst_eq);
+								// %def = MOV64rm @.ptr + 0*0 + offset 
 
-				inst_eq->insertBefore(inst_user);
+								// # 1254a6 <_end+0x121486>
 
-			}
+								if (ux_log_level >= LOG_LEVEL_INFO) errs() << n_inst;
 
-			inst_user->replaceUsesOfWith(&glob, *(v_ins_eq.end() - 1));
+								changed = true;
 
-		}
+								continue;
 
-	}
+							} 
 
-}
+							// Otherwise, it's an external use and base instruction can't be deleted (base instr : MOV64ri %addr)
+							reg_not_used = false;
 
-void create_decode_function(Module& mod, Function* &function_out) {
+						}
 
-	// Declare and initialize function prototype
+					}
+				
+					if (reg_not_used) {
+						/* remove base if reg is not used */
 
-	auto &ctx = mod.getContext();
+						it_inst = --bbl.erase(&inst);
 
-	auto ty_ptr_str = Type::getInt8Ty(ctx)->getPointerTo();
-	auto ty_key = Type::getInt8Ty(ctx);
-	auto ty_sz_str = Type::getInt64Ty(ctx);
+						changed = true;
 
-	std::vector<Type*> ty_args = {
-		ty_ptr_str,
-		ty_key,
-		ty_sz_str
-		};
+					}
 
+				} 
 
-	Function* dec_fn = Function::Create(
-		FunctionType::get(Type::getVoidTy(ctx), ty_args, false),
-		GlobalValue::LinkageTypes::ExternalLinkage,
-		"obf_decode",
-		mod
-		);
+			}
 
-	dec_fn->addFnAttr(Attribute::get(
-		ctx,
-		Attribute::AlwaysInline
-		)); // Always inline this function
+		}
 
-	dec_fn->setCallingConv(CallingConv::C);
-			
+		return changed;
 
-	auto args = dec_fn->arg_begin();
+	}
 
-	Value* arg_ptr_str = args++;
-	arg_ptr_str->setName("ptr_str");
+};
 
-	Value* arg_key = args++;
-	arg_key->setName("key");
-	
-	Value* arg_sz_str = args++;
-	arg_sz_str->setName("sz_str");
 
 
-	// Start defining function and filling it with instructions
+typedef SmallVector<std::pair<StringRef, StringRef>, 4> pass_params_t;
 
-	/*
+/* Matches 'name' against 'pass_name' or 'pass_name<p1;p2=v2>' and splits the parameters.
+	Parameters are separated by ';' since ',' already separates passes on pipeline text */
+bool parse_pass_params(StringRef name, StringRef pass_name, pass_params_t& params_out) {
 
-	entry:
+	if (!name.consume_front(pass_name)) return false;
 
-		%i0 = alloca i64
+	if (name.empty()) return true; // no parameters given
 
-		store i64 0, i64* %i0
+	if (!name.consume_front("<") || !name.consume_back(">")) return false;
 
-		br label %repeat
+	SmallVector<StringRef, 4> params = {};
+	name.split(params, ';', -1, false /* skip empty */);
 
-	repeat:
+	for (StringRef param : params)
+		params_out.push_back(param.split('='));
 
-		%i0tmp = load i64, i64* %i0
+	return true;
 
-		%cond = icmp ugt %szStr, %i0tmp
+}
 
-		br i1 %cond, label %decode, label %end
+bool parse_integer_param(StringRef pass_name, StringRef key, StringRef val, size_t min, size_t max, size_t& out) {
 
-	decode:
+	if (val.getAsInteger(10, out) || !IN_RANGE(out, min, max)) {
 
-		%arg_ptr_str_int = ptrtoint i8* arg_ptr_str to i64
+		LOG_ERROR("Parameter '" + key + "' of pass '" + pass_name + "' must be an integer in range "
+			+ std::to_string(min) + "-" + std::to_string(max) + ".");
 
-		%ptr_char_int = add i64 arg_ptr_str_int, %i0tmp
+		return false;
 
-		%ptr_char = inttoptr i64 %ptr_char_int to i8*
+	}
 
-		%e_val = load i8, i8* %ptr_char
+	return true;
 
-		%d_val = xor i8 %e_val, i8 %key
+}
 
-		store i8 %d_val, i8* %ptr_char
+bool parse_unknown_param(StringRef pass_name, StringRef key) {
 
-		%i0tmp2 = add i64 %i0tmp, i64 1
+	LOG_ERROR("Unknown parameter '" + key + "' for pass '" + pass_name + "'.");
 
-		store i64 %i0tmp2, i64* %i0 
+	return false;
 
-		br label repeat
+}
 
-	end:
+bool parse_strings_options(const pass_params_t& params, transforms::strings_options& opts) {
 
-		ret
+	for (auto& [key, val] : params) {
 
-	*/
+		if (key == "depth") {
 
-	BasicBlock* bl_entry = BasicBlock::Create(
-		ctx, "entry", dec_fn
-		); /* entry block */
+			// Equations need at least two levels to produce a root slot
+			if (!parse_integer_param("ux-strings", key, val, 2, 1000, opts.depth)) return false;
 
-	BasicBlock* bl_repeat = BasicBlock::Create(
-		ctx, "repeat", dec_fn
-		); /* repeat block */
+		} else if (key == "mode") {
 
-	BasicBlock* bl_decode = BasicBlock::Create(
-		ctx, "decode", dec_fn
-		); /* decode block */
+			if (val == "inline") opts.mode = transforms::strings_mode::INLINE;
+			else if (val == "startup") opts.mode = transforms::strings_mode::STARTUP;
+			else if (val == "shared") opts.mode = transforms::strings_mode::SHARED;
+			else {
 
-	BasicBlock* bl_end = BasicBlock::Create(
-		ctx, "end", dec_fn
-		); /* end block */
+				LOG_ERROR("Parameter 'mode' of pass 'ux-strings' must be one of inline/startup/shared.");
 
+				return false;
 
-	// Create entry block instructions
+			}
 
-	IRBuilder<>* builder = new IRBuilder<>(bl_entry);
+		} else if (key == "encoding") {
 
-	auto var_i0 = builder->CreateAlloca(
-		Type::getInt64Ty(ctx),
-		nullptr /* not an array */,
-		"i0"
-		); // %i0 = alloca i64
+			if (val == "equations") opts.encoding = transforms::strings_encoding::EQUATIONS;
+			else if (val == "keystream") opts.encoding = transforms::strings_encoding::KEYSTREAM;
+			else {
 
-	builder->CreateStore(
-		ConstantInt::get(Type::getInt64Ty(ctx), 0),
-		var_i0
-		); // store i64 0, i64* %i0
-			
-	builder->CreateBr(bl_repeat); // br label %repeat
+				LOG_ERROR("Parameter 'encoding' of pass 'ux-strings' must be one of equations/keystream.");
 
-	
-	// Create repeat block instructions
+				return false;
 
-	builder = new IRBuilder<>(bl_repeat);
+			}
 
-	auto var_i0tmp = builder->CreateLoad(
-		Type::getInt64Ty(ctx),
-		var_i0,
-		"i0tmp"
-		); // %i0tmp = load i64, i64* %i0
+		} else return parse_unknown_param("ux-strings", key);
 
-	auto var_cond = builder->CreateICmpUGT(
-		arg_sz_str,
-		var_i0tmp,
-		"cond"
-		); // %cond = icmp ugt %szStr, %i0tmp
+	}
 
-	builder->CreateCondBr(
-		var_cond,
-		bl_decode,
-		bl_end
-		); // br i1 %cond, label %decode, label %end
+	return true;
 
-	
-	// Create decode block instructions
+}
 
-	builder = new IRBuilder<>(bl_decode);
+bool parse_refs_options(const pass_params_t& params, transforms::refs_options& opts) {
 
-	auto var_arg_ptr_str_int = builder->CreatePtrToInt(
-		arg_ptr_str,
-		Type::getInt64Ty(ctx),
-		"arg_ptr_str_int"
-		); // %arg_ptr_str_int = ptrtoint i8* arg_ptr_str to i64
+	for (auto& [key, val] : params) {
 
-	auto var_ptr_char_int = builder->CreateAdd(
-		var_arg_ptr_str_int,
-		var_i0tmp,
-		"ptr_char_int"
-		); // %ptr_char_int = add i64 arg_ptr_str_int, %i0tmp
+		if (key == "depth") {
 
-	auto var_ptr_char = builder->CreateIntToPtr(
-		var_ptr_char_int,
-		Type::getInt8Ty(ctx)->getPointerTo(),
-		"ptr_char"
-		); // %ptr_char = inttoptr i64 %ptr_char_int to i8*
+			if (!parse_integer_param("ux-refs", key, val, 2, 1000, opts.depth)) return false;
 
-	auto var_e_val = builder->CreateLoad(
-		Type::getInt8Ty(ctx),
-		var_ptr_char,
-		"e_val"
-		); // %e_val = load i8, i8* %ptr_char
+		} else return parse_unknown_param("ux-refs", key);
 
-	auto var_d_val = builder->CreateXor(
-		var_e_val,
-		arg_key,
-		"d_val"
-		); // %d_val = xor i8 %e_val, i8 %key
+	}
 
-	builder->CreateStore(
-		var_d_val,
-		var_ptr_char
-		); // store i8 %d_val, i8* %ptr_char
+	return true;
 
-	auto var_i0tmp2 = builder->CreateAdd(
-		var_i0tmp,
-		ConstantInt::get(Type::getInt64Ty(ctx), 1),
-		"i0tmp2"
-		); // %i0tmp2 = add i64 %i0tmp, i64 1
+}
 
-	builder->CreateStore(
-		var_i0tmp2,
-		var_i0
-		); // store i64 %i0tmp2, i64* %i0
+bool parse_consts_options(const pass_params_t& params, transforms::consts_options& opts) {
 
-	builder->CreateBr(bl_repeat); // br label repeat
+	for (auto& [key, val] : params) {
 
+		if (key == "depth") {
 
-	// Create end block instructions
+			if (!parse_integer_param("ux-consts", key, val, 2, 1000, opts.depth)) return false;
 
-	builder = new IRBuilder<>(bl_end);
+		} else return parse_unknown_param("ux-consts", key);
 
-	builder->CreateRetVoid(); // ret
+	}
 
-	function_out = dec_fn;
+	return true;
 
 }
 
-bool runPass(Module &M) {
-
-    auto& ctx = M.getContext();
-
-    // Obfuscate strings
-
-	obfuscate_string_literals(M);
-
-	// Obfuscate references
-
-	obfuscate_references(M);
+bool parse_pool_options(const pass_params_t& params, transforms::pool_options& opts) {
 
-	return false;
+	for (auto& [key, val] : params) {
 
-	auto g_strings = encode_string_literals(M);
+		if (key == "depth") {
 
-    // Create decode function
+			if (!parse_integer_param("ux-pool", key, val, 2, 1000, opts.depth)) return false;
 
-    Function* fn_decode;
-    create_decode_function(M, fn_decode);
+		} else return parse_unknown_param("ux-pool", key);
 
+	}
 
-    // Add calls to decode function for every encoded string
+	return true;
 
-    Function* fn_main = M.getFunction("main");
+}
 
-    BasicBlock* bl_dec_stub = BasicBlock::Create(
-        ctx,
-        "obf_decode_stub"
-        );
+bool parse_mba_options(const pass_params_t& params, transforms::mba_options& opts) {
 
-    IRBuilder<>* builder = new IRBuilder<>(bl_dec_stub);
+	for (auto& [key, val] : params) {
 
-    for (GlobalVariable* g_string : g_strings) {
+		if (key == "budget") {
 
-        std::vector<Value*> args = {
-            g_string, // arg_ptr_str
-            ConstantInt::get(
-                Type::getInt8Ty(ctx),
-                0xAF,
-                false /* not signed */
-            ), // arg_key
-            ConstantInt::get(
-                Type::getInt64Ty(ctx),
-                cast<ConstantDataArray>(g_string->getInitializer())->getAsString().size()
-            ) // arg_sz_str
-            };
+			// Cheapest identities cost 3 cycles
+			size_t budget = 0;
 
-        builder->CreateCall(fn_decode, args);
+			if (!parse_integer_param("ux-mba", key, val, 3, 100, budget)) return false;
 
-    }
+			opts.budget = static_cast<unsigned>(budget);
 
-    ir_manager::module::set_function_hook(bl_dec_stub, fn_main); // test
+		} else return parse_unknown_param("ux-mba", key);
 
-    ir_manager::function::bogus_control_flow(fn_main, 2); // test
-    ir_manager::function::bogus_control_flow(fn_decode, 2); // test
+	}
 
-    return false;
+	return true;
 
 }
 
+template <typename opts_t>
+bool parse_times_options(StringRef pass_name, const pass_params_t& params, opts_t& opts) {
 
-struct IRPass : PassInfoMixin<IRPass> {
-    PreservedAnalyses run(Module &M, ModuleAnalysisManager &) {
-        if (!runPass(M))
-            return PreservedAnalyses::all();
-        return PreservedAnalyses::none();
-    }
-};
+	for (auto& [key, val] : params) {
 
-class MIRPass : public MachineFunctionPass {
+		if (key == "times") {
 
-public:
+			size_t times = 0;
 
-	static char ID;
+			if (!parse_integer_param(pass_name, key, val, 1, 100, times)) return false;
 
-	MIRPass() : MachineFunctionPass(ID) {
+			opts.times = static_cast<unsigned short>(times);
 
-		// InitX86MCInstrInfo(&x86_ii); // init x86 instruction set
+		} else return parse_unknown_param(pass_name, key);
 
 	}
 
-	bool runOnMachineFunction(MachineFunction &MF) override {
+	return true;
 
-		const TargetInstrInfo* x86_tii = MF.getSubtarget().getInstrInfo();
+}
 
-		MachineRegisterInfo& x86_mri = MF.getRegInfo();
+/*
+Parses the obfuscation pipeline elements:
+
+	ux<strings;refs;split;bcf;mba;pool;consts;cleanup> runs given stages in order with default parameters
+	ux-strings<depth=N;mode=inline|startup|shared;encoding=equations|keystream>
+	ux-refs<depth=N>
+	ux-split<times=N>
+	ux-bcf<times=N>
+	ux-mba<budget=N>                       rewrites user add/sub/xor/and/or into linear MBA forms costing up to N cycles
+	ux-pool<depth=N>                       moves internal constant tables into a pool decoded by a constructor
+	ux-consts<depth=N>                     hides integer constants of user code behind one opaque equation per function
+	ux-cleanup                             rewrites ptrtoint/inttoptr round trips into GEPs, after strings/refs
+	ux-survival                            reports how many !ux.obf tagged instructions are left
+
+'ux' without parameters and the legacy 'obfstrings' name run strings and refs.
+Stages expanding functions (all but pool and cleanup) share their growth budget when '-ux-budget=P' is given,
+see budget::tracker.
+*/
+bool parse_pipeline_element(StringRef name, ModulePassManager& pm) {
 
-		errs() << "Running on function: " << MF.getName() << "\n";
+	pass_params_t params = {};
 
-		for (auto it_bbl = MF.begin(); it_bbl != MF.end(); ++it_bbl) {
+	if (parse_pass_params(name, "ux-strings", params)) {
 
-			MachineBasicBlock& bbl = *it_bbl;
+		StringsPass pass;
+		if (!parse_strings_options(params, pass.opts)) return false;
 
-			for (auto it_inst = bbl.begin(); it_inst != bbl.end(); ++it_inst) {
+		pm.addPass(std::move(pass));
+		return true;
 
-				MachineInstr& inst = *it_inst;
+	}
 
-				if (inst.getOpcode() == X86::MOV64ri) {
+	if (parse_pass_params(name, "ux-refs", params)) {
 
-					MachineOperand& op_base = inst.getOperand(1);
+		ReferencesPass pass;
+		if (!parse_refs_options(params, pass.opts)) return false;
 
-					if (!op_base.isGlobal()) continue;
+		pm.addPass(std::move(pass));
+		return true;
 
-					/* getOperand(0) yields the return vreg */
-					Register reg_addr = inst.getOperand(0).getReg();
+	}
 
-					bool reg_not_used = true;
+	if (parse_pass_params(name, "ux-split", params)) {
 
-					auto n_it_inst = it_inst;
-					for (++n_it_inst; n_it_inst != bbl.end(); ++n_it_inst) {
+		SplitPass pass;
+		if (!parse_times_options("ux-split", params, pass.opts)) return false;
 
-						MachineInstr& n_inst = *n_it_inst;
+		pm.addPass(std::move(pass));
+		return true;
 
-						if (n_inst.modifiesRegister(reg_addr, nullptr)) break;
+	}
 
-						if (n_inst.readsRegister(reg_addr, nullptr)) {
+	if (parse_pass_params(name, "ux-bcf", params)) {
 
-							// If pattern matches, then it's not considered a use
-							if (n_inst.getOpcode() == X86::ADD64ri32) {
+		BogusControlFlowPass pass;
+		if (!parse_times_options("ux-bcf", params, pass.opts)) return false;
 
-								MachineOperand& op_dest = n_inst.getOperand(1);
-								MachineOperand& op_offset = n_inst.getOperand(2);
+		pm.addPass(std::move(pass));
+		return true;
 
-								if (!op_dest.isReg()
-									|| op_dest.getReg() != reg_addr
-									|| !op_offset.isImm()) continue;
+	}
 
-								int64_t op_offset_i = op_offset.getImm();
+	if (parse_pass_params(name, "ux-mba", params)) {
 
-								MIMetadata mi_md = MIMetadata(DebugLoc());
+		MBAPass pass;
+		if (!parse_mba_options(params, pass.opts)) return false;
 
-								const MCInstrDesc& mc_idesc = x86_tii->get(X86::LEA64r);
+		pm.addPass(std::move(pass));
+		return true;
 
-								// errs() << "Constraints: " << mc_idesc.operands()[0].Constraints << "\n";
+	}
 
-								Register reg_use = n_inst.getOperand(0).getReg();
+	if (parse_pass_params(name, "ux-consts", params)) {
 
-								// MachineInstr* mi_lea = BuildMI(
-									// bbl,
-									// it_inst,
-									// mi_md,
-									// mc_idesc,
-									// reg_use)
-									// .addGlobalAddress(op_base.getGlobal(), op_offset.getImm());
+		ConstantsPass pass;
+		if (!parse_consts_options(params, pass.opts)) return false;
 
-								// First, remove all operands except the def
-								while (n_inst.getNumOperands() > 1) {
-									n_inst.removeOperand(1);
-								}
+		pm.addPass(std::move(pass));
+		return true;
 
-								n_inst.setDesc(mc_idesc);
+	}
 
-								n_inst.addOperand(MachineOperand::CreateReg(X86::RIP, false)); // base
+	if (parse_pass_params(name, "ux-pool", params)) {
 
-								n_inst.addOperand(MachineOperand::CreateImm(1)); // scale
+		PoolPass pass;
+		if (!parse_pool_options(params, pass.opts)) return false;
 
-								n_inst.addOperand(MachineOperand::CreateReg(X86::NoRegister, false)); // index
+		pm.addPass(std::move(pass));
+		return true;
 
-								n_inst.addOperand(
-									MachineOperand::CreateGA(
-										op_base.getGlobal(),
-										op_offset_i)); // disp
+	}
 
-								n_inst.addOperand(MachineOperand::CreateReg(X86::NoRegister, false)); // seg
+	if (name == "ux-cleanup") {
 
-								// %def = MOV64rm @.ptr + 0*0 + offset 
+		pm.addPass(CleanupPass());
+		return true;
 
-								// # 1254a6 <_end+0x121486>
+	}
 
-								errs() << n_inst;
+	if (name == "ux-survival") {
 
-								continue;
+		pm.addPass(SurvivalPass());
+		return true;
 
-							} 
+	}
 
-							// Otherwise, it's an external use and base instruction can't be deleted (base instr : MOV64ri %addr)
-							reg_not_used = false;
+	if (name == "obfstrings") name = "ux"; // legacy name
 
-						}
+	if (parse_pass_params(name, "ux", params)) {
 
-					}
-				
-					if (reg_not_used) {
-						/* remove base if reg is not used */
+		if (params.empty())
+			params = { { "strings", "" }, { "refs", "" } };
 
-						it_inst = --bbl.erase(&inst);
+		for (auto& [stage, val] : params) {
 
-					}
+			if (!val.empty()) {
 
-				} 
+				LOG_ERROR("Stages of pass 'ux' don't take values, use 'ux-" + stage + "<...>' instead.");
+
+				return false;
 
 			}
 
+			if (stage == "strings") pm.addPass(StringsPass());
+			else if (stage == "refs") pm.addPass(ReferencesPass());
+			else if (stage == "split") pm.addPass(SplitPass());
+			else if (stage == "bcf") pm.addPass(BogusControlFlowPass());
+			else if (stage == "mba") pm.addPass(MBAPass());
+			else if (stage == "pool") pm.addPass(PoolPass());
+			else if (stage == "consts") pm.addPass(ConstantsPass());
+			else if (stage == "cleanup") pm.addPass(CleanupPass());
+			else return parse_unknown_param("ux", stage);
+
 		}
 
-		return false;
+		return true;
 
 	}
 
-};
+	return false;
 
+}
 
 } // namespace
 
@@ -715,13 +699,7 @@ llvm::PassPluginLibraryInfo getIRPassPluginInfo() {
 				[](StringRef Name, ModulePassManager &PM,
 					ArrayRef<PassBuilder::PipelineElement>) {
 					
-					if (Name == "obfstrings") {
-						// Run IR pass
-						PM.addPass(IRPass());
-						return true;
-					}
-					
-					return false;
+					return parse_pipeline_element(Name, PM);
 				
 				});
 
@@ -743,4 +721,19 @@ static RegisterPass<MIRPass> MIRPASS(
 	"wv-mir-pass",
 	"WareVisor Machine IR Pass for MIR-level code obfuscation",
 	false,
-	false);
\ No newline at end of file
+	false);
+
+// Insert Machine IR Pass right after instruction selection, so a single
+// llc (or clang -fpass-plugin) invocation folds references in-memory
+// instead of round-tripping through a .mir file
+static RegisterTargetPassConfigCallback MIRPASS_PIPELINE(
+	[](TargetMachine& TM, PassManagerBase&, TargetPassConfig* pass_config) {
+
+		if (!MIRInPipeline) return;
+
+		// Pass rewrites x86-64 opcodes, which are different instructions on any other target
+		if (!TM.getTargetTriple().isX86() || !TM.getTargetTriple().isArch64Bit()) return;
+
+		pass_config->insertPass(&FinalizeISelID, &MIRPass::ID);
+
+	});
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "include/mba.hpp"
+
+#include "include/utils.hpp"
+
+#include "llvm/IR/IRBuilder.h"
+
+
+using namespace llvm;
+
+
+namespace mba {
+
+namespace {
+
+	constexpr size_t NUM_BEXPRS = static_cast<size_t>(bexpr::ONES) + 1;
+
+	/* Identity table, 'x opcode y' == sum of terms for every width */
+	constexpr std::array<identity, 21> IDENTITIES = {{
+
+		// x + y
+		{ Instruction::Add, {{ { 1, bexpr::XOR }, { 2, bexpr::AND } }}, 2 },
+		{ Instruction::Add, {{ { 1, bexpr::OR }, { 1, bexpr::AND } }}, 2 },
+		{ Instruction::Add, {{ { 2, bexpr::OR }, { -1, bexpr::XOR } }}, 2 },
+		{ Instruction::Add, {{ { 1, bexpr::X }, { -1, bexpr::NOT_Y }, { 1, bexpr::ONES } }}, 3 },
+		{ Instruction::Add, {{ { 1, bexpr::X_AND_NOT_Y }, { 1, bexpr::NOT_X_AND_Y }, { 2, bexpr::AND } }}, 3 },
+
+		// x - y
+		{ Instruction::Sub, {{ { 1, bexpr::XOR }, { -2, bexpr::NOT_X_AND_Y } }}, 2 },
+		{ Instruction::Sub, {{ { 1, bexpr::X_AND_NOT_Y }, { -1, bexpr::NOT_X_AND_Y } }}, 2 },
+		{ Instruction::Sub, {{ { 1, bexpr::X }, { 1, bexpr::NOT_Y }, { -1, bexpr::ONES } }}, 3 },
+		{ Instruction::Sub, {{ { 2, bexpr::X_AND_NOT_Y }, { -1, bexpr::XOR } }}, 2 },
+
+		// x ^ y
+		{ Instruction::Xor, {{ { 1, bexpr::OR }, { -1, bexpr::AND } }}, 2 },
+		{ Instruction::Xor, {{ { 1, bexpr::X }, { 1, bexpr::Y }, { -2, bexpr::AND } }}, 3 },
+		{ Instruction::Xor, {{ { 1, bexpr::X_AND_NOT_Y }, { 1, bexpr::NOT_X_AND_Y } }}, 2 },
+		{ Instruction::Xor, {{ { 2, bexpr::OR }, { -1, bexpr::X }, { -1, bexpr::Y } }}, 3 },
+
+		// x & y
+		{ Instruction::And, {{ { 1, bexpr::OR }, { -1, bexpr::XOR } }}, 2 },
+		{ Instruction::And, {{ { 1, bexpr::X }, { 1, bexpr::Y }, { -1, bexpr::OR } }}, 3 },
+		{ Instruction::And, {{ { 1, bexpr::NOT_X_OR_Y }, { -1, bexpr::NOT_X } }}, 2 },
+		{ Instruction::And, {{ { 1, bexpr::Y }, { -1, bexpr::NOT_X_AND_Y } }}, 2 },
+
+		// x | y
+		{ Instruction::Or, {{ { 1, bexpr::XOR }, { 1, bexpr::AND } }}, 2 },
+		{ Instruction::Or, {{ { 1, bexpr::X }, { 1, bexpr::Y }, { -1, bexpr::AND } }}, 3 },
+		{ Instruction::Or, {{ { 1, bexpr::X }, { 1, bexpr::NOT_X_AND_Y } }}, 2 },
+		{ Instruction::Or, {{ { 1, bexpr::X_AND_NOT_Y }, { 1, bexpr::Y } }}, 2 }
+
+	}};
+
+	/* Identities summing to zero (opcode is unused), mixed into a rewrite with a random coefficient */
+	constexpr std::array<identity, 3> ZERO_IDENTITIES = {{
+
+		{ Instruction::BinaryOpsEnd, {{ { 1, bexpr::XOR }, { -1, bexpr::OR }, { 1, bexpr::AND } }}, 3 },
+		{ Instruction::BinaryOpsEnd, {{ { 1, bexpr::X }, { 1, bexpr::Y }, { -1, bexpr::OR }, { -1, bexpr::AND } }}, 4 },
+		{ Instruction::BinaryOpsEnd, {{ { 1, bexpr::X }, { 1, bexpr::NOT_X }, { -1, bexpr::ONES } }}, 3 }
+
+	}};
+
+	template <typename T>
+	constexpr T eval_bexpr(bexpr expr, T x, T y) {
+
+		switch (expr) {
+			case bexpr::X: return x;
+			case bexpr::Y: return y;
+			case bexpr::NOT_X: return static_cast<T>(~x);
+			case bexpr::NOT_Y: return static_cast<T>(~y);
+			case bexpr::AND: return static_cast<T>(x & y);
+			case bexpr::OR: return static_cast<T>(x | y);
+			case bexpr::XOR: return static_cast<T>(x ^ y);
+			case bexpr::X_AND_NOT_Y: return static_cast<T>(x & ~y);
+			case bexpr::NOT_X_AND_Y: return static_cast<T>(~x & y);
+			case bexpr::X_OR_NOT_Y: return static_cast<T>(x | ~y);
+			case bexpr::NOT_X_OR_Y: return static_cast<T>(~x | y);
+			case bexpr::NAND: return static_cast<T>(~(x & y));
+			case bexpr::NOR: return static_cast<T>(~(x | y));
+			case bexpr::XNOR: return static_cast<T>(~(x ^ y));
+			case bexpr::ONES: return static_cast<T>(~static_cast<T>(0));
+		}
+
+		return 0;
+
+	}
+
+	/* Arithmetic is done on 64 bits and truncated, narrow types would be promoted to (signed) int */
+	template <typename T>
+	constexpr T eval_identity(const identity& id, T x, T y) {
+
+		uint64_t res = 0;
+
+		for (size_t i = 0; i < id.n_terms; ++i)
+			res += static_cast<uint64_t>(id.terms[i].coef) * eval_bexpr<T>(id.terms[i].expr, x, y);
+
+		return static_cast<T>(res);
+
+	}
+
+	template <typename T>
+	constexpr T eval_target(Instruction::BinaryOps opcode, T x, T y) {
+
+		switch (opcode) {
+			case Instruction::Add: return static_cast<T>(static_cast<uint64_t>(x) + y);
+			case Instruction::Sub: return static_cast<T>(static_cast<uint64_t>(x) - y);
+			case Instruction::Xor: return static_cast<T>(x ^ y);
+			case Instruction::And: return static_cast<T>(x & y);
+			case Instruction::Or: return static_cast<T>(x | y);
+			default: return 0; // zero identities
+		}
+
+	}
+
+	/* A linear MBA identity holds for every width iff it holds on each single bit, so the
+		truth table proves it, and the samples check the width specific evaluation on top */
+	template <typename T, size_t N>
+	constexpr bool verify_identities(const std::array<identity, N>& ids) {
+
+		constexpr uint64_t samples[][2] = {
+			{ 0, 0 }, { 0, ~0ull }, { 1, 2 }, { ~0ull, 1 },
+			{ 0x5A5A5A5A5A5A5A5Aull, 0xC3C3C3C3C3C3C3C3ull },
+			{ 0x8000000000000000ull, 0x7FFFFFFFFFFFFFFFull },
+			{ 0x0123456789ABCDEFull, 0xFEDCBA9876543210ull }
+		};
+
+		for (const identity& id : ids) {
+
+			for (int64_t x = 0; x <= 1; ++x) {
+
+				for (int64_t y = 0; y <= 1; ++y) {
+
+					int64_t sum = 0;
+
+					for (size_t i = 0; i < id.n_terms; ++i)
+						sum += id.terms[i].coef * (eval_bexpr<uint8_t>(id.terms[i].expr, static_cast<uint8_t>(x), static_cast<uint8_t>(y)) & 1);
+
+					int64_t target = 0;
+
+					switch (id.opcode) {
+						case Instruction::Add: target = x + y; break;
+						case Instruction::Sub: target = x - y; break;
+						case Instruction::Xor: target = x ^ y; break;
+						case Instruction::And: target = x & y; break;
+						case Instruction::Or: target = x | y; break;
+						default: break;
+					}
+
+					if (sum != target) return false;
+
+				}
+
+			}
+
+			for (auto& sample : samples) {
+
+				T x = static_cast<T>(sample[0]);
+				T y = static_cast<T>(sample[1]);
+
+				if (eval_identity<T>(id, x, y) != eval_target<T>(id.opcode, x, y)) return false;
+
+			}
+
+		}
+
+		return true;
+
+	}
+
+	static_assert(verify_identities<uint8_t>(IDENTITIES) && verify_identities<uint8_t>(ZERO_IDENTITIES),
+		"MBA identities don't hold on 8 bits");
+	static_assert(verify_identities<uint16_t>(IDENTITIES) && verify_identities<uint16_t>(ZERO_IDENTITIES),
+		"MBA identities don't hold on 16 bits");
+	static_assert(verify_identities<uint32_t>(IDENTITIES) && verify_identities<uint32_t>(ZERO_IDENTITIES),
+		"MBA identities don't hold on 32 bits");
+	static_assert(verify_identities<uint64_t>(IDENTITIES) && verify_identities<uint64_t>(ZERO_IDENTITIES),
+		"MBA identities don't hold on 64 bits");
+
+	typedef IRBuilder<ConstantFolder, IRBuilderCallbackInserter> mba_builder_t;
+
+	/* Bitwise expressions are emitted once per rewrite and shared by its terms */
+	typedef std::array<Value*, NUM_BEXPRS> bexpr_cache_t;
+
+	/* Operands which terms of an identity are computed from */
+	struct operands_t {
+		Value* v_x;
+		Value* v_y;
+		bexpr_cache_t cache;
+	};
+
+	Value* emit_bexpr(mba_builder_t& builder, bexpr expr, Value* v_x, Value* v_y, bexpr_cache_t& cache) {
+
+		Value*& v_expr = cache[static_cast<size_t>(expr)];
+
+		if (v_expr) return v_expr;
+
+		switch (expr) {
+			case bexpr::X: v_expr = v_x; break;
+			case bexpr::Y: v_expr = v_y; break;
+			case bexpr::NOT_X: v_expr = builder.CreateNot(v_x); break;
+			case bexpr::NOT_Y: v_expr = builder.CreateNot(v_y); break;
+			case bexpr::AND: v_expr = builder.CreateAnd(v_x, v_y); break;
+			case bexpr::OR: v_expr = builder.CreateOr(v_x, v_y); break;
+			case bexpr::XOR: v_expr = builder.CreateXor(v_x, v_y); break;
+			case bexpr::X_AND_NOT_Y: v_expr = builder.CreateAnd(v_x, emit_bexpr(builder, bexpr::NOT_Y, v_x, v_y, cache)); break;
+			case bexpr::NOT_X_AND_Y: v_expr = builder.CreateAnd(emit_bexpr(builder, bexpr::NOT_X, v_x, v_y, cache), v_y); break;
+			case bexpr::X_OR_NOT_Y: v_expr = builder.CreateOr(v_x, emit_bexpr(builder, bexpr::NOT_Y, v_x, v_y, cache)); break;
+			case bexpr::NOT_X_OR_Y: v_expr = builder.CreateOr(emit_bexpr(builder, bexpr::NOT_X, v_x, v_y, cache), v_y); break;
+			case bexpr::NAND: v_expr = builder.CreateNot(emit_bexpr(builder, bexpr::AND, v_x, v_y, cache)); break;
+			case bexpr::NOR: v_expr = builder.CreateNot(emit_bexpr(builder, bexpr::OR, v_x, v_y, cache)); break;
+			case bexpr::XNOR: v_expr = builder.CreateNot(emit_bexpr(builder, bexpr::XOR, v_x, v_y, cache)); break;
+			case bexpr::ONES: v_expr = Constant::getAllOnesValue(v_x->getType()); break;
+		}
+
+		return v_expr;
+
+	}
+
+	/* Adds each term of 'id' to 'v_acc' (may be null), coefficients are truncated to T.
+		Terms take their operands from 'ops' in turn */
+	template <typename T>
+	Value* emit_identity(mba_builder_t& builder, const identity& id, MutableArrayRef<operands_t> ops, Value* v_acc) {
+
+		IntegerType* ty_val = decide_integer_type<T>(builder.getContext());
+
+		for (size_t i = 0; i < id.n_terms; ++i) {
+
+			const term& t = id.terms[i];
+
+			operands_t& ops_term = ops[i % ops.size()];
+
+			T coef_abs = static_cast<T>(t.coef < 0 ? -static_cast<uint64_t>(t.coef) : static_cast<uint64_t>(t.coef));
+
+			if (!coef_abs) continue;
+
+			Value* v_term = emit_bexpr(builder, t.expr, ops_term.v_x, ops_term.v_y, ops_term.cache);
+
+			if ((coef_abs & (coef_abs - 1)) == 0) {
+
+				if (coef_abs != 1)
+					v_term = builder.CreateShl(v_term, ConstantInt::get(ty_val, Log2_64(coef_abs)));
+
+			} else v_term = builder.CreateMul(v_term, ConstantInt::get(ty_val, coef_abs));
+
+			if (!v_acc) v_acc = t.coef < 0 ? builder.CreateNeg(v_term) : v_term;
+			else v_acc = t.coef < 0 ? builder.CreateSub(v_acc, v_term) : builder.CreateAdd(v_acc, v_term);
+
+		}
+
+		return v_acc;
+
+	}
+
+	template <typename T>
+	bool rewrite_binop_t(BinaryOperator* inst, unsigned budget, Value* v_opaque_zero, std::vector<Instruction*>& insts_out) {
+
+		SmallVector<const identity*, 8> candidates = {};
+
+		for (const identity& id : IDENTITIES) {
+
+			if (id.opcode == inst->getOpcode() && cost_of(id) <= budget)
+				candidates.push_back(&id);
+
+		}
+
+		if (candidates.empty()) return false;
+
+		const identity& id = *candidates[gen_random_int<size_t>(0, candidates.size() - 1)];
+
+		unsigned budget_left = budget - cost_of(id);
+
+		mba_builder_t builder(inst->getContext(), ConstantFolder(),
+			IRBuilderCallbackInserter([&](Instruction* inst_new) { insts_out.push_back(inst_new); }));
+
+		builder.SetInsertPoint(inst);
+
+		Value* v_x = inst->getOperand(0);
+		Value* v_y = inst->getOperand(1);
+
+		SmallVector<operands_t, 2> ops = { { v_x, v_y, {} } };
+
+		if (v_opaque_zero && COST_OPAQUE_OPERANDS <= budget_left) {
+
+			ops.push_back({ builder.CreateXor(v_x, v_opaque_zero), builder.CreateXor(v_y, v_opaque_zero), {} });
+
+			budget_left -= COST_OPAQUE_OPERANDS;
+
+		}
+
+		Value* v_res = emit_identity<T>(builder, id, ops, nullptr);
+
+		// k * 0 is mixed in, so the form doesn't match the table entry as is
+		identity id_zero = ZERO_IDENTITIES[gen_random_int<size_t>(0, ZERO_IDENTITIES.size() - 1)];
+
+		int64_t coef_zero = static_cast<int64_t>(gen_random_int<uint64_t>(2, 255)) * (gen_random_int<int>(0, 1) ? 1 : -1);
+
+		for (size_t i = 0; i < id_zero.n_terms; ++i)
+			id_zero.terms[i].coef *= coef_zero;
+
+		if (cost_of(id_zero) + 1 <= budget_left)
+			v_res = emit_identity<T>(builder, id_zero, ops, v_res);
+
+		v_res->takeName(inst);
+
+		inst->replaceAllUsesWith(v_res);
+		inst->eraseFromParent();
+
+		return true;
+
+	}
+
+}
+
+bool is_rewritable(const BinaryOperator* inst) {
+
+	switch (inst->getOpcode()) {
+		case Instruction::Add: case Instruction::Sub:
+		case Instruction::Xor: case Instruction::And: case Instruction::Or:
+			break;
+		default:
+			return false;
+	}
+
+	if (!inst->getType()->isIntegerTy()) return false; // vectors are left alone
+
+	// Folded by the builder, so there would be nothing left to replace it with
+	if (isa<Constant>(inst->getOperand(0)) && isa<Constant>(inst->getOperand(1))) return false;
+
+	switch (inst->getType()->getIntegerBitWidth()) {
+		case 8: case 16: case 32: case 64: return true;
+		default: return false;
+	}
+
+}
+
+bool rewrite_binop(BinaryOperator* inst, unsigned budget, Value* v_opaque_zero, std::vector<Instruction*>& insts_out) {
+
+	switch (inst->getType()->getIntegerBitWidth()) {
+		case 8: return rewrite_binop_t<uint8_t>(inst, budget, v_opaque_zero, insts_out);
+		case 16: return rewrite_binop_t<uint16_t>(inst, budget, v_opaque_zero, insts_out);
+		case 32: return rewrite_binop_t<uint32_t>(inst, budget, v_opaque_zero, insts_out);
+		case 64: return rewrite_binop_t<uint64_t>(inst, budget, v_opaque_zero, insts_out);
+		default: return false;
+	}
+
+}
+
+}
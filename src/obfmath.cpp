@@ -3,6 +3,15 @@
 
 #include "include/utils.hpp"
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/KnownBits.h"
+#include "llvm/Support/MathExtras.h"
+
+#define DEBUG_TYPE "ux-obfuscator"
+
 
 #define MAX_UINT8 0xFF
 #define MAX_UINT16 0xFFFF
@@ -12,30 +21,167 @@
 using namespace llvm;
 
 
+STATISTIC(NumEquationsEmitted, "Number of opaque equations emitted");
+STATISTIC(NumEquationNodesRejected, "Number of equation nodes rejected since they fold on instruction simplification");
+
+static cl::opt<bool> ScheduleEquations(
+	"ux-schedule-equations",
+	cl::desc("Order equation instructions by register need, opaque loads right before their first use"),
+	cl::init(true));
+
+static cl::opt<bool> EquationOracle(
+	"ux-equation-oracle",
+	cl::desc("Reject equation nodes which instruction simplification or known bits would fold, and pick another operator"),
+	cl::init(true));
+
+
+namespace {
+
+	/* Retries of a rejected node, last candidate is kept regardless so generation always progresses */
+	constexpr size_t MAX_ORACLE_TRIES = 8;
+
+	/* Checks whether the optimizer would fold any instruction of a candidate node into an operand or a constant
+		(x ^ x, or with all-ones, mul by zero...), so it would only cost compile time */
+	bool folds_on_peephole(const std::vector<Value*>& insts_node, const DataLayout& dl) {
+
+		const SimplifyQuery query(dl);
+
+		for (Value* val_node : insts_node) {
+
+			BinaryOperator* inst_node = cast<BinaryOperator>(val_node);
+
+			if (simplifyBinOp(inst_node->getOpcode(), inst_node->getOperand(0), inst_node->getOperand(1), query))
+				return true;
+
+			if (computeKnownBits(inst_node, dl).isConstant())
+				return true;
+
+		}
+
+		return false;
+
+	}
+
+	/*
+	Reorders 'insts' (operands before users) in a Sethi-Ullman fashion: every node is emitted by a post-order
+	walk from the values nobody in 'insts' uses, visiting the operand which needs more registers first, so
+	its result is the only one held while the other operand is computed. Leaves like opaque loads come
+	right before their first user instead of all at the start.
+	This only shortens live ranges in the IR order. The machine scheduler reorders again at -O2, and constants
+	hoisted out of loops by LICM keep a register each, so it doesn't remove spills from hot functions.
+	*/
+	void order_by_register_need(std::vector<Value*>& insts) {
+
+		DenseMap<Value*, unsigned> needs;
+		needs.reserve(insts.size());
+
+		SmallPtrSet<Value*, 32> used_inside = {};
+
+		auto get_operands = [&](Value* val, SmallVectorImpl<Value*>& ops_out) {
+
+			ops_out.clear();
+
+			for (Value* op : cast<Instruction>(val)->operands())
+				if (needs.count(op) && !is_contained(ops_out, op)) ops_out.push_back(op);
+
+			// Operand needing more registers goes first
+			llvm::stable_sort(ops_out, [&](Value* a, Value* b) { return needs.lookup(a) > needs.lookup(b); });
+
+		};
+
+		SmallVector<Value*, 2> ops = {};
+
+		for (Value* val : insts) {
+
+			get_operands(val, ops);
+
+			unsigned need = 1;
+
+			for (size_t i = 0; i < ops.size(); ++i) {
+
+				need = std::max<unsigned>(need, needs.lookup(ops[i]) + i);
+
+				used_inside.insert(ops[i]);
+
+			}
+
+			needs[val] = need;
+
+		}
+
+		std::vector<Value*> ordered = {};
+		ordered.reserve(insts.size());
+
+		SmallPtrSet<Value*, 32> visited = {};
+
+		// Post-order walk with an explicit stack, equations may be a thousand levels deep
+		std::vector<std::pair<Value*, size_t>> stack = {};
+
+		for (Value* val_root : insts) {
+
+			if (used_inside.count(val_root) || !visited.insert(val_root).second) continue;
+
+			stack.push_back({ val_root, 0 });
+
+			while (!stack.empty()) {
+
+				auto& [val, i_op] = stack.back();
+
+				get_operands(val, ops);
+
+				while (i_op < ops.size() && visited.count(ops[i_op])) ++i_op;
+
+				if (i_op < ops.size()) {
+
+					Value* op = ops[i_op];
+
+					visited.insert(op);
+					stack.push_back({ op, 0 });
+
+					continue;
+
+				}
+
+				ordered.push_back(val);
+				stack.pop_back();
+
+			}
+
+		}
+
+		insts = std::move(ordered);
+
+	}
+
+}
+
+
 namespace math {
 
 	template <typename T>
-	insval_t generate_equation(
-		Module& mod,
+	std::vector<Value*> generate_equation_roots(
+		emit::context& ectx,
 		const std::vector<insval_t>& opaque_vals,
-		size_t num_deepness) {
+		size_t num_deepness,
+		size_t num_roots,
+		std::vector<insval_t>& roots_out) {
 
-		typedef insval_t(*binop_cb_t)(const insval_t*, const insval_t*);
+		typedef insval_t(*binop_cb_t)(const insval_t*, const insval_t*, const emit::constants&);
 
 		struct insval_pack {
 			insval_t insval;
 			bool used = false;
 		};
 
-		auto& ctx = mod.getContext();
+		IntegerType* ty_val = ectx.tys.get<T>();
 
-		IntegerType* ty_val = decide_integer_type<T>(ctx);
+		const DataLayout& dl = ectx.mod.getDataLayout();
 
 		static std::array<binop_cb_t, 8> binop_cbs = {
 
 			/* NOT, ADD, SUB, MUL, DIV, OR, XOR, SHL, LSHR */
 
-			[](const insval_t* operand_1, const insval_t* operand_2 = nullptr) -> insval_t { // NOT
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants&) -> insval_t { // NOT
 
 				UNUSED(operand_2);
 
@@ -46,7 +192,7 @@ namespace math {
 
 			},
 
-			[](const insval_t* operand_1, const insval_t* operand_2) -> insval_t { // ADD
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants&) -> insval_t { // ADD
 
 				return {
 					{ BinaryOperator::CreateAdd(*(operand_1->first.end() - 1), *(operand_2->first.end() - 1)) },
@@ -55,7 +201,7 @@ namespace math {
 
 			},
 
-			[](const insval_t* operand_1, const insval_t* operand_2) -> insval_t { // SUB
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants&) -> insval_t { // SUB
 
 				return {
 					{ BinaryOperator::CreateSub(*(operand_1->first.end() - 1), *(operand_2->first.end() - 1)) },
@@ -64,7 +210,7 @@ namespace math {
 
 			},
 
-			[](const insval_t* operand_1, const insval_t* operand_2) -> insval_t { // MUL
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants&) -> insval_t { // MUL
 
 				return {
 					{ BinaryOperator::CreateMul(*(operand_1->first.end() - 1), *(operand_2->first.end() - 1)) },
@@ -73,7 +219,7 @@ namespace math {
 
 			},
 
-			[](const insval_t* operand_1, const insval_t* operand_2) -> insval_t { // OR
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants&) -> insval_t { // OR
 
 				return {
 					{ BinaryOperator::CreateOr(*(operand_1->first.end() - 1), *(operand_2->first.end() - 1)) },
@@ -82,7 +228,7 @@ namespace math {
 
 			},
 
-			[](const insval_t* operand_1, const insval_t* operand_2) -> insval_t { // XOR
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants&) -> insval_t { // XOR
 
 				return {
 					{ BinaryOperator::CreateXor(*(operand_1->first.end() - 1), *(operand_2->first.end() - 1)) },
@@ -91,31 +237,91 @@ namespace math {
 
 			},
 
-			[](const insval_t* operand_1, const insval_t* operand_2) -> insval_t { // SHL
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants& consts) -> insval_t { // SHL
+
+				// Shift amount is masked to the width, shifting by width or more yields poison
+				Value* v_amount = *(operand_2->first.end() - 1);
+				Instruction* inst_amount = BinaryOperator::CreateAnd(v_amount, consts.shift_mask<T>());
 
 				return {
-					{ BinaryOperator::CreateShl(*(operand_1->first.end() - 1), *(operand_2->first.end() - 1)) },
-					static_cast<T>(operand_1->second << operand_2->second)
+					{ inst_amount, BinaryOperator::CreateShl(*(operand_1->first.end() - 1), inst_amount) },
+					static_cast<T>(operand_1->second << (operand_2->second & (sizeof(T) * 8 - 1)))
 				};
 
 			},
 
-			[](const insval_t* operand_1, const insval_t* operand_2) -> insval_t { // LSHR
+			[](const insval_t* operand_1, const insval_t* operand_2, const emit::constants& consts) -> insval_t { // LSHR
+
+				// Shift amount is masked to the width, shifting by width or more yields poison
+				Value* v_amount = *(operand_2->first.end() - 1);
+				Instruction* inst_amount = BinaryOperator::CreateAnd(v_amount, consts.shift_mask<T>());
 
 				return {
-					{ BinaryOperator::CreateLShr(*(operand_1->first.end() - 1), *(operand_2->first.end() - 1)) },
-					static_cast<T>(operand_1->second >> operand_2->second)
+					{ inst_amount, BinaryOperator::CreateLShr(*(operand_1->first.end() - 1), inst_amount) },
+					static_cast<T>(static_cast<T>(operand_1->second) >> (operand_2->second & (sizeof(T) * 8 - 1)))
 				};
 
 			}
 
 		};
 
+		// Picks an operator from 'i_op_first' on, until the node survives the oracle
+		auto gen_node = [&](size_t i_op_first, const insval_t* operand_1, const insval_t* operand_2) -> insval_t {
+
+			for (size_t n_try = 1; ; ++n_try) {
+
+				insval_t res_operator = binop_cbs[gen_random_int<size_t>(i_op_first, binop_cbs.size()-1)](operand_1, operand_2, ectx.consts);
+
+				if (!EquationOracle || n_try >= MAX_ORACLE_TRIES || !folds_on_peephole(res_operator.first, dl))
+					return res_operator;
+
+				// Users come after their operands, so deleting backwards never leaves a dangling use
+				for (auto it_inst = res_operator.first.rbegin(); it_inst != res_operator.first.rend(); ++it_inst)
+					(*it_inst)->deleteValue();
+
+				NumEquationNodesRejected++;
+
+			}
+
+		};
+
 		size_t num_slots = opaque_vals.size();
 
+		std::vector<Value*> insts_out = {};
+
+		// Slots of a deepness only feed the next one, so they are flushed to 'insts_out' (or deleted
+		// if nothing picked them) as soon as the next deepness is done. Only two rows are alive at once.
+		auto flush_slots = [&](std::vector<insval_pack>& slots_on_depth) {
+
+			for (insval_pack& slot : slots_on_depth) {
+
+				auto& insts_slot = slot.insval.first;
+
+				if (!slot.used) { // clear instructions of slot from memory
+
+					for (auto* inst_slot : insts_slot) {
+
+						inst_slot->replaceAllUsesWith(UndefValue::get(inst_slot->getType()));
+
+						inst_slot->deleteValue(); // delete instruction from memory
+
+					}
+
+					continue;
+
+				}
+
+				insts_out.insert(insts_out.end(), insts_slot.begin(), insts_slot.end());
+
+			}
+
+			slots_on_depth.clear();
+
+		};
+
 		// Generate and initialize slots with initial random values
-		// Slots are two dimensional, first dimension is for 'deepness (number of iterations)'.
-		std::vector<std::vector<insval_pack>> slots(num_deepness, std::vector<insval_pack>(num_slots));
+		std::vector<insval_pack> slots_prev(num_slots);
+		std::vector<insval_pack> slots_cur = {};
 
 		for (size_t i = 0; i < num_slots; ++i) {
 
@@ -128,18 +334,19 @@ namespace math {
 
 			const insval_t* opaque_val = &opaque_vals[i];
 
-			insval_t res_operator = binop_cbs[gen_random_int<size_t>(1 /* NOT operator is not accepted */, binop_cbs.size()-1)](
+			insval_t res_operator = gen_node(
+				1 /* NOT operator is not accepted */,
 				&rnd_insval,
 				opaque_val);
 
-			insval_pack& slot = slots[0][i];
+			insval_pack& slot = slots_prev[i];
 			auto& insts_slot = slot.insval.first;
 
 			// Push opaque value's instructions to instruction list first	
 			insts_slot.insert(insts_slot.begin(), opaque_val->first.begin(), opaque_val->first.end());
 
-			// Now push binary operator instruction
-			insts_slot.push_back(res_operator.first[0]); // Binary operators consist of single instruction
+			// Now push binary operator instructions (shifts mask their amount first)
+			insts_slot.insert(insts_slot.end(), res_operator.first.begin(), res_operator.first.end());
 
 			// Set the resultant fixed value
 			slot.insval.second = static_cast<uint64_t>(res_operator.second);
@@ -147,7 +354,10 @@ namespace math {
 		}
 
 
-		for (size_t deepness = 1; deepness < num_deepness; ++deepness) {
+		// Last deepness is made of the roots, every other one is as wide as the opaque values
+		for (size_t deepness = 1; deepness + 1 < num_deepness; ++deepness) {
+
+			slots_cur.resize(num_slots);
 
 			for (size_t i = 0; i < num_slots; ++i) {
 
@@ -156,398 +366,345 @@ namespace math {
 				size_t i_slot_1 = i_slots[0];
 				size_t i_slot_2 = i_slots[1];
 
-				insval_pack& slot_1 = slots[deepness - 1][i_slot_1]; // we picked up a slot randomly and we are going to assume it as first operand
-				insval_pack& slot_2 = slots[deepness - 1][i_slot_2]; // we also picked up a slot randomly and we are going to assume it as second operand
+				insval_pack& slot_1 = slots_prev[i_slot_1]; // we picked up a slot randomly and we are going to assume it as first operand
+				insval_pack& slot_2 = slots_prev[i_slot_2]; // we also picked up a slot randomly and we are going to assume it as second operand
 
-				insval_t res_operator = binop_cbs[
-					gen_random_int<size_t>(0, binop_cbs.size()-1)
-				](&slot_1.insval, &slot_2.insval); // we randomly picked up an operator and performed operation on it
+				insval_t res_operator = gen_node(
+					0, &slot_1.insval, &slot_2.insval); // we randomly picked up an operator and performed operation on it
 
-				insval_pack& slot = slots[deepness][i];
+				insval_pack& slot = slots_cur[i];
 				auto& insts_slot = slot.insval.first;
 
-				insts_slot.push_back(res_operator.first[0]);
+				insts_slot.insert(insts_slot.end(), res_operator.first.begin(), res_operator.first.end());
 
 				slot.insval.second = static_cast<uint64_t>(res_operator.second);
 
 				slot_1.used = true;
 				slot_2.used = true;
 
-				// On the last deepness, we only need to compute one slot which is going to be returned
-				if (deepness == num_deepness - 1) {
+			}
 
-					slots[deepness].resize(1);
+			flush_slots(slots_prev);
 
-					slot.used = true;
+			std::swap(slots_prev, slots_cur);
 
-					break;
+		}
 
-				}
+		// Each root is a single operation on two nodes of the remaining row, which is shared by all of them
 
-			}
+		roots_out.clear();
+		roots_out.reserve(num_roots);
 
-		}
+		for (size_t i = 0; i < num_roots; ++i) {
 
-		insval_t insval_out;
-		auto& insts_out = insval_out.first;
-		insval_out.second = slots[num_deepness - 1][0].insval.second;
+			auto i_slots = gen_random_int<size_t, 2>(0, num_slots - 1);
 
-		for (size_t i = 0; i < num_deepness; ++i) {
+			insval_pack& slot_1 = slots_prev[i_slots[0]];
+			insval_pack& slot_2 = slots_prev[i_slots[1]];
 
-			auto& slots_on_depth = slots[i];
+			roots_out.push_back(gen_node(0, &slot_1.insval, &slot_2.insval));
 
-			for (size_t j = 0; j < slots_on_depth.size(); ++j) {
+			slot_1.used = true;
+			slot_2.used = true;
 
-				insval_pack& slot = slots_on_depth[j];
-				auto& insts_slot = slot.insval.first;
+		}
 
-				if (!slot.used) { // clear instructions of slot from memory
+		flush_slots(slots_prev);
 
-					for (auto* inst_slot : slot.insval.first) {
+		if (ScheduleEquations) order_by_register_need(insts_out);
 
-						inst_slot->replaceAllUsesWith(UndefValue::get(inst_slot->getType()));
+		NumEquationsEmitted++;
 
-						inst_slot->deleteValue(); // delete instruction from memory
+		return insts_out;
 
-					}
+	}
 
-					continue;
+	template <typename T>
+	insval_t generate_equation(
+		emit::context& ectx,
+		const std::vector<insval_t>& opaque_vals,
+		size_t num_deepness) {
 
-				}
+		std::vector<insval_t> roots = {};
 
-				insts_out.insert(insts_out.end(), insts_slot.begin(), insts_slot.end());
+		insval_t insval_out = { generate_equation_roots<T>(ectx, opaque_vals, num_deepness, 1, roots), 0 };
 
-			}
+		insval_out.first.insert(insval_out.first.end(), roots[0].first.begin(), roots[0].first.end());
+		insval_out.second = roots[0].second;
 
-		}
+		// Root only reads two nodes of the DAG, which are scheduled last once it's added
+		if (ScheduleEquations) order_by_register_need(insval_out.first);
 
 		return insval_out;
 
 	}
 
 
-	std::vector<Instruction*> obfuscate_string_literal(Module& mod, StringRef str) {
-
-		auto& ctx = mod.getContext();
+	namespace {
 
-		std::vector<Instruction*> instr_out = {};
+		/* Strings are rebuilt in words of this size, their stack buffer is padded to a whole number of words */
+		constexpr size_t SZ_STR_WORD = sizeof(uint64_t);
 
-		size_t sz_str = str.size();
+		/* Word of 'str' at 'offset' in the byte order of the target, bytes past the end of 'str' are zero */
+		uint64_t read_string_word(StringRef str, size_t offset, bool big_endian) {
 
-		// Define integer types once to avoid multiple initialization
+			uint64_t val_word = 0;
 
-		IntegerType* ty_i8 = Type::getInt8Ty(ctx);
-		IntegerType* ty_i16 = Type::getInt16Ty(ctx);
-		IntegerType* ty_i32 = Type::getInt32Ty(ctx);
-		IntegerType* ty_i64 = Type::getInt64Ty(ctx);
+			for (size_t i = 0; i < SZ_STR_WORD && offset + i < str.size(); ++i) {
 
-		// Allocate some space for resulting string on stack
+				uint64_t val_byte = static_cast<unsigned char>(str[offset + i]);
 
-		Instruction* addr_str_stack = new AllocaInst(
-			ty_i8, 0,
-			ConstantInt::get(ty_i8, sz_str),
-			mod.getDataLayout().getPrefTypeAlign(ty_i8),
-			"", (Instruction*)nullptr
-			);
-		instr_out.push_back(addr_str_stack);
+				val_word |= val_byte << (8 * (big_endian ? SZ_STR_WORD - 1 - i : i));
 
+			}
 
-		const unsigned char* str_begin = str.bytes_begin();
+			return val_word;
 
-		while (sz_str > 0) {
+		}
 
-			if (sz_str >= 8) {
+		/* Stores the rebuilt word 'v_word' at 'offset' bytes past 'addr_str' */
+		void store_string_word(emit::context& ectx, Value* addr_str, size_t offset, Value* v_word) {
 
-				const uint64_t i64_str = *reinterpret_cast<const uint64_t*>(str_begin);
+			IntegerType* ty_i64 = ectx.tys.ty_i64;
 
-				uint64_t val_opaque_1 = gen_random_int<uint64_t>(MAX_UINT16, MAX_UINT64);
-				uint64_t val_opaque_2 = gen_random_int<uint64_t>(MAX_UINT16, MAX_UINT64);
-				uint64_t val_opaque_3 = gen_random_int<uint64_t>(MAX_UINT16, MAX_UINT64);
+			Instruction* v_i_addr_str = new PtrToIntInst(
+				addr_str, ty_i64,
+				"", (Instruction*)nullptr
+			);
+			ectx.append(v_i_addr_str);
 
-				// Push the opaque values
+			Instruction* v_i_addr_str_curr = BinaryOperator::CreateAdd(
+				v_i_addr_str,
+				ConstantInt::get(ty_i64, offset)
+			);
+			ectx.append(v_i_addr_str_curr);
 
-				auto itrs_opaque_1 = opaque::opaque_by_user_shared_data(mod, val_opaque_1, 64);
-				auto itrs_opaque_2 = opaque::opaque_by_user_shared_data(mod, val_opaque_2, 64);
-				auto itrs_opaque_3 = opaque::opaque_by_user_shared_data(mod, val_opaque_3, 64);
+			Instruction* v_addr_str_curr = new IntToPtrInst(
+				v_i_addr_str_curr,
+				ectx.tys.ty_ptr
+			);
+			ectx.append(v_addr_str_curr);
 
-				std::vector<Value*> vals_opaque_1(itrs_opaque_1.begin(), itrs_opaque_1.end());
-				std::vector<Value*> vals_opaque_2(itrs_opaque_2.begin(), itrs_opaque_2.end());
-				std::vector<Value*> vals_opaque_3(itrs_opaque_3.begin(), itrs_opaque_3.end());
+			// Buffer and offset are both word aligned
+			ectx.append(new StoreInst(
+				v_word, v_addr_str_curr, false,
+				Align(SZ_STR_WORD),
+				(Instruction*)nullptr
+			));
 
-				insval_t opaque_1 = { vals_opaque_1, val_opaque_1 };
-				insval_t opaque_2 = { vals_opaque_2, val_opaque_2 };
-				insval_t opaque_3 = { vals_opaque_3, val_opaque_3 };
+		}
 
-				std::vector<insval_t> opaque_vals = { opaque_1, opaque_2, opaque_3 };
+		/* Rebuilds 'val_word' from 'root' of a shared equation, and stores it 'offset' bytes past 'addr_str' */
+		void emit_string_word(
+			emit::context& ectx, Value* addr_str, size_t offset,
+			uint64_t val_word, const insval_t& root) {
 
-				insval_t insval_eq = generate_equation<uint64_t>(mod, opaque_vals, 30);
-				auto& insts_eq = insval_eq.first;
+			ectx.append(root.first);
 
-				instr_out.insert(
-					instr_out.end(),
-					reinterpret_cast<Instruction**>(&*insts_eq.begin()),
-					reinterpret_cast<Instruction**>(&*insts_eq.end()));
+			const uint64_t val_kval = val_word ^ root.second;
 
-				const uint64_t val_kval = i64_str ^ insval_eq.second;
+			Instruction* v_str = BinaryOperator::CreateXor(
+				root.first.back(),
+				ConstantInt::get(ectx.tys.ty_i64, val_kval));
+			ectx.append(v_str);
 
-				Instruction* v_str = BinaryOperator::CreateXor(
-					*(instr_out.end() - 1),
-					ConstantInt::get(ty_i64, val_kval));
+			store_string_word(ectx, addr_str, offset, v_str);
 
-				instr_out.push_back(v_str);
+		}
 
-				size_t offset = static_cast<size_t>(str_begin - str.bytes_begin());
+		/* Three opaque 64-bit values in [MAX_UINT16, MAX_UINT64], which equations of the module are built on */
+		std::vector<insval_t> gen_opaque_values(emit::context& ectx) {
 
-				Instruction* v_i_addr_str = new PtrToIntInst(
-					addr_str_stack, ty_i64,
-					"", (Instruction*)nullptr
-				);
-				instr_out.push_back(v_i_addr_str);
+			std::vector<insval_t> opaque_vals = {};
 
-				Instruction* v_i_addr_str_curr = BinaryOperator::CreateAdd(
-					v_i_addr_str,
-					ConstantInt::get(ty_i64, offset)
-				);
-				instr_out.push_back(v_i_addr_str_curr);
+			for (size_t i = 0; i < 3; ++i) {
 
-				Instruction* v_addr_str_curr = new IntToPtrInst(
-					v_i_addr_str_curr,
-					ty_i64->getPointerTo()
-				);
-				instr_out.push_back(v_addr_str_curr);
+				uint64_t val_opaque = gen_random_int<uint64_t>(MAX_UINT16, MAX_UINT64);
 
-				instr_out.push_back(new StoreInst(
-					v_str, v_addr_str_curr, false,
-					mod.getDataLayout().getPrefTypeAlign(ty_i64),
-					(Instruction*)nullptr
-				));
+				auto insts_opaque = opaque::opaque_by_user_shared_data(ectx, val_opaque, 64);
 
-				str_begin += 8;
-				sz_str -= 8;
+				opaque_vals.push_back({ std::vector<Value*>(insts_opaque.begin(), insts_opaque.end()), val_opaque });
 
 			}
 
-			else if (sz_str >= 4) {
+			return opaque_vals;
 
-				const uint32_t i32_str = *reinterpret_cast<const uint32_t*>(str_begin);
+		}
 
-				uint32_t val_opaque_1 = gen_random_int<uint32_t>(MAX_UINT16, MAX_UINT32);
-				uint32_t val_opaque_2 = gen_random_int<uint32_t>(MAX_UINT16, MAX_UINT32);
-				uint32_t val_opaque_3 = gen_random_int<uint32_t>(MAX_UINT16, MAX_UINT32);
+		/* Shifts of the xorshift64 generator (Marsaglia, 13/7/17), a nonzero state never becomes zero */
+		constexpr unsigned KS_SHIFT_A = 13;
+		constexpr unsigned KS_SHIFT_B = 7;
+		constexpr unsigned KS_SHIFT_C = 17;
 
-				// Push the opaque values
+		/* Host side step of the keystream, must match 'emit_keystream_step' */
+		constexpr uint64_t keystream_step(uint64_t x) {
 
-				auto itrs_opaque_1 = opaque::opaque_by_user_shared_data(mod, val_opaque_1, 32);
-				auto itrs_opaque_2 = opaque::opaque_by_user_shared_data(mod, val_opaque_2, 32);
-				auto itrs_opaque_3 = opaque::opaque_by_user_shared_data(mod, val_opaque_3, 32);
+			x ^= x << KS_SHIFT_A;
+			x ^= x >> KS_SHIFT_B;
+			x ^= x << KS_SHIFT_C;
 
-				std::vector<Value*> vals_opaque_1(itrs_opaque_1.begin(), itrs_opaque_1.end());
-				std::vector<Value*> vals_opaque_2(itrs_opaque_2.begin(), itrs_opaque_2.end());
-				std::vector<Value*> vals_opaque_3(itrs_opaque_3.begin(), itrs_opaque_3.end());
+			return x;
 
-				insval_t opaque_1 = { vals_opaque_1, val_opaque_1 };
-				insval_t opaque_2 = { vals_opaque_2, val_opaque_2 };
-				insval_t opaque_3 = { vals_opaque_3, val_opaque_3 };
+		}
 
-				std::vector<insval_t> opaque_vals = { opaque_1, opaque_2, opaque_3 };
+		/* Appends one xorshift64 step on 'v_state', six ALU instructions kept in registers */
+		Instruction* emit_keystream_step(emit::context& ectx, Value* v_state, const std::array<ConstantInt*, 3>& c_shifts) {
 
-				insval_t insval_eq = generate_equation<uint32_t>(mod, opaque_vals, 30);
-				auto& insts_eq = insval_eq.first;
+			Instruction* v_shl_a = BinaryOperator::CreateShl(v_state, c_shifts[0]);
+			ectx.append(v_shl_a);
+			Instruction* v_xor_a = BinaryOperator::CreateXor(v_state, v_shl_a);
+			ectx.append(v_xor_a);
 
-				instr_out.insert(
-					instr_out.end(),
-					reinterpret_cast<Instruction**>(&*insts_eq.begin()),
-					reinterpret_cast<Instruction**>(&*insts_eq.end()));
+			Instruction* v_shr_b = BinaryOperator::CreateLShr(v_xor_a, c_shifts[1]);
+			ectx.append(v_shr_b);
+			Instruction* v_xor_b = BinaryOperator::CreateXor(v_xor_a, v_shr_b);
+			ectx.append(v_xor_b);
 
-				const uint32_t val_kval = i32_str ^ static_cast<uint32_t>(insval_eq.second);
+			Instruction* v_shl_c = BinaryOperator::CreateShl(v_xor_b, c_shifts[2]);
+			ectx.append(v_shl_c);
+			Instruction* v_xor_c = BinaryOperator::CreateXor(v_xor_b, v_shl_c);
+			ectx.append(v_xor_c);
 
-				Instruction* v_str = BinaryOperator::CreateXor(
-					*(instr_out.end() - 1),
-					ConstantInt::get(ty_i32, val_kval));
+			return v_xor_c;
 
-				instr_out.push_back(v_str);
+		}
 
-				size_t offset = static_cast<size_t>(str_begin - str.bytes_begin());
+		/* Buffer on stack which a string is rebuilt into, 'sz_padded' bytes aligned to a word */
+		Instruction* emit_string_buffer(emit::context& ectx, size_t sz_padded) {
 
-				Instruction* v_i_addr_str = new PtrToIntInst(
-					addr_str_stack, ty_i64,
-					"", (Instruction*)nullptr
-				);
-				instr_out.push_back(v_i_addr_str);
+			const DataLayout& dl = ectx.mod.getDataLayout();
 
-				Instruction* v_i_addr_str_curr = BinaryOperator::CreateAdd(
-					v_i_addr_str,
-					ConstantInt::get(ty_i64, offset)
+			Instruction* addr_str_stack = new AllocaInst(
+				ectx.tys.ty_i8, dl.getAllocaAddrSpace(),
+				ConstantInt::get(ectx.tys.ty_i64, sz_padded),
+				Align(SZ_STR_WORD),
+				"", (Instruction*)nullptr
 				);
-				instr_out.push_back(v_i_addr_str_curr);
+			ectx.append(addr_str_stack);
 
-				Instruction* v_addr_str_curr = new IntToPtrInst(
-					v_i_addr_str_curr,
-					ty_i32->getPointerTo()
-				);
-				instr_out.push_back(v_addr_str_curr);
+			return addr_str_stack;
 
-				instr_out.push_back(new StoreInst(
-					v_str, v_addr_str_curr, false,
-					mod.getDataLayout().getPrefTypeAlign(ty_i32),
-					(Instruction*)nullptr
-				));
-
-				str_begin += 4;
-				sz_str -= 4;
+		}
 
-			}
+	}
 
-			else if (sz_str >= 2) {
 
-				const uint16_t i16_str = *reinterpret_cast<const uint16_t*>(str_begin);
+	insval_t emit_opaque_equation(emit::context& ectx, size_t num_deepness) {
 
-				uint16_t val_opaque_1 = gen_random_int<uint16_t>(MAX_UINT8, MAX_UINT16);
-				uint16_t val_opaque_2 = gen_random_int<uint16_t>(MAX_UINT8, MAX_UINT16);
-				uint16_t val_opaque_3 = gen_random_int<uint16_t>(MAX_UINT8, MAX_UINT16);
+		insval_t insval_eq = generate_equation<uint64_t>(ectx, gen_opaque_values(ectx), num_deepness);
 
-				// Push the opaque values
+		ectx.append(insval_eq.first);
 
-				auto itrs_opaque_1 = opaque::opaque_by_user_shared_data(mod, val_opaque_1, 16);
-				auto itrs_opaque_2 = opaque::opaque_by_user_shared_data(mod, val_opaque_2, 16);
-				auto itrs_opaque_3 = opaque::opaque_by_user_shared_data(mod, val_opaque_3, 16);
+		return insval_eq;
 
-				std::vector<Value*> vals_opaque_1(itrs_opaque_1.begin(), itrs_opaque_1.end());
-				std::vector<Value*> vals_opaque_2(itrs_opaque_2.begin(), itrs_opaque_2.end());
-				std::vector<Value*> vals_opaque_3(itrs_opaque_3.begin(), itrs_opaque_3.end());
+	}
 
-				insval_t opaque_1 = { vals_opaque_1, val_opaque_1 };
-				insval_t opaque_2 = { vals_opaque_2, val_opaque_2 };
-				insval_t opaque_3 = { vals_opaque_3, val_opaque_3 };
+	void emit_opaque_roots(emit::context& ectx, size_t num_deepness, size_t num_roots, std::vector<insval_t>& roots_out) {
 
-				std::vector<insval_t> opaque_vals = { opaque_1, opaque_2, opaque_3 };
+		ectx.append(generate_equation_roots<uint64_t>(
+			ectx, gen_opaque_values(ectx), num_deepness, num_roots, roots_out));
 
-				insval_t insval_eq = generate_equation<uint16_t>(mod, opaque_vals, 30);
-				auto& insts_eq = insval_eq.first;
+	}
 
-				instr_out.insert(
-					instr_out.end(),
-					reinterpret_cast<Instruction**>(&*insts_eq.begin()),
-					reinterpret_cast<Instruction**>(&*insts_eq.end()));
+	Value* obfuscate_string_literal(emit::context& ectx, StringRef str, size_t num_deepness) {
 
-				const uint16_t val_kval = i16_str ^ static_cast<uint16_t>(insval_eq.second);
+		const DataLayout& dl = ectx.mod.getDataLayout();
 
-				Instruction* v_str = BinaryOperator::CreateXor(
-					*(instr_out.end() - 1),
-					ConstantInt::get(ty_i16, val_kval));
+		// Tail of the string is rebuilt as a whole word too, every word takes its own root of a shared equation
 
-				instr_out.push_back(v_str);
+		size_t sz_padded = padded_string_size(str.size());
 
-				size_t offset = static_cast<size_t>(str_begin - str.bytes_begin());
+		Instruction* addr_str_stack = emit_string_buffer(ectx, sz_padded);
 
-				Instruction* v_i_addr_str = new PtrToIntInst(
-					addr_str_stack, ty_i64,
-					"", (Instruction*)nullptr
-				);
-				instr_out.push_back(v_i_addr_str);
+		std::vector<insval_t> roots = {};
+		emit_opaque_roots(ectx, num_deepness, sz_padded / SZ_STR_WORD, roots);
 
-				Instruction* v_i_addr_str_curr = BinaryOperator::CreateAdd(
-					v_i_addr_str,
-					ConstantInt::get(ty_i64, offset)
-				);
-				instr_out.push_back(v_i_addr_str_curr);
+		for (size_t offset = 0; offset < sz_padded; offset += SZ_STR_WORD) {
 
-				Instruction* v_addr_str_curr = new IntToPtrInst(
-					v_i_addr_str_curr,
-					ty_i16->getPointerTo()
-				);
-				instr_out.push_back(v_addr_str_curr);
+			emit_string_word(ectx, addr_str_stack, offset,
+				read_string_word(str, offset, dl.isBigEndian()), roots[offset / SZ_STR_WORD]);
 
-				instr_out.push_back(new StoreInst(
-					v_str, v_addr_str_curr, false,
-					mod.getDataLayout().getPrefTypeAlign(ty_i16),
-					(Instruction*)nullptr
-				));
+		}
 
-				str_begin += 2;
-				sz_str -= 2;
+		Instruction* v_str = new BitCastInst(addr_str_stack, ectx.tys.ty_ptr);
+		ectx.append(v_str);
 
-			}
+		return v_str;
 
-			else {
+	}
 
-				const uint8_t i8_str = *reinterpret_cast<const uint8_t*>(str_begin);
+	Value* obfuscate_string_literal_keystream(emit::context& ectx, StringRef str, size_t num_deepness) {
 
-				uint8_t val_opaque_1 = gen_random_int<uint8_t>(0, MAX_UINT8);
-				uint8_t val_opaque_2 = gen_random_int<uint8_t>(0, MAX_UINT8);
-				uint8_t val_opaque_3 = gen_random_int<uint8_t>(0, MAX_UINT8);
+		const DataLayout& dl = ectx.mod.getDataLayout();
+		IntegerType* ty_i64 = ectx.tys.ty_i64;
 
-				// Push the opaque values
+		size_t sz_padded = padded_string_size(str.size());
 
-				auto itrs_opaque_1 = opaque::opaque_by_user_shared_data(mod, val_opaque_1, 8);
-				auto itrs_opaque_2 = opaque::opaque_by_user_shared_data(mod, val_opaque_2, 8);
-				auto itrs_opaque_3 = opaque::opaque_by_user_shared_data(mod, val_opaque_3, 8);
+		Instruction* addr_str_stack = emit_string_buffer(ectx, sz_padded);
 
-				std::vector<Value*> vals_opaque_1(itrs_opaque_1.begin(), itrs_opaque_1.end());
-				std::vector<Value*> vals_opaque_2(itrs_opaque_2.begin(), itrs_opaque_2.end());
-				std::vector<Value*> vals_opaque_3(itrs_opaque_3.begin(), itrs_opaque_3.end());
+		// Seed is the only value taken from an opaque equation, mixed with a key keeping the state nonzero
 
-				insval_t opaque_1 = { vals_opaque_1, val_opaque_1 };
-				insval_t opaque_2 = { vals_opaque_2, val_opaque_2 };
-				insval_t opaque_3 = { vals_opaque_3, val_opaque_3 };
+		insval_t insval_eq = emit_opaque_equation(ectx, num_deepness);
 
-				std::vector<insval_t> opaque_vals = { opaque_1, opaque_2, opaque_3 };
+		uint64_t val_seed_key = 0;
+		do val_seed_key = gen_random_int<uint64_t>(0, MAX_UINT64);
+		while ((insval_eq.second ^ val_seed_key) == 0);
 
-				insval_t insval_eq = generate_equation<uint8_t>(mod, opaque_vals, 30);
-				auto& insts_eq = insval_eq.first;
+		uint64_t val_state = insval_eq.second ^ val_seed_key;
 
-				instr_out.insert(
-					instr_out.end(),
-					reinterpret_cast<Instruction**>(&*insts_eq.begin()),
-					reinterpret_cast<Instruction**>(&*insts_eq.end()));
+		Instruction* v_state = BinaryOperator::CreateXor(
+			insval_eq.first.back(),
+			ConstantInt::get(ty_i64, val_seed_key));
+		ectx.append(v_state);
 
-				const uint8_t val_kval = i8_str ^ static_cast<uint8_t>(insval_eq.second);
+		const std::array<ConstantInt*, 3> c_shifts = {
+			ConstantInt::get(ty_i64, KS_SHIFT_A),
+			ConstantInt::get(ty_i64, KS_SHIFT_B),
+			ConstantInt::get(ty_i64, KS_SHIFT_C) };
 
-				Instruction* v_str = BinaryOperator::CreateXor(
-					*(instr_out.end() - 1),
-					ConstantInt::get(ty_i8, val_kval));
+		for (size_t offset = 0; offset < sz_padded; offset += SZ_STR_WORD) {
 
-				instr_out.push_back(v_str);
+			// Host encrypts the word with the same keystream which the emitted code generates
 
-				size_t offset = static_cast<size_t>(str_begin - str.bytes_begin());
+			val_state = keystream_step(val_state);
+			v_state = emit_keystream_step(ectx, v_state, c_shifts);
 
-				Instruction* v_i_addr_str = new PtrToIntInst(
-					addr_str_stack, ty_i64,
-					"", (Instruction*)nullptr
-				);
-				instr_out.push_back(v_i_addr_str);
+			const uint64_t val_kval = read_string_word(str, offset, dl.isBigEndian()) ^ val_state;
 
-				Instruction* v_i_addr_str_curr = BinaryOperator::CreateAdd(
-					v_i_addr_str,
-					ConstantInt::get(ty_i64, offset)
-				);
-				instr_out.push_back(v_i_addr_str_curr);
+			Instruction* v_word = BinaryOperator::CreateXor(v_state, ConstantInt::get(ty_i64, val_kval));
+			ectx.append(v_word);
 
-				Instruction* v_addr_str_curr = new IntToPtrInst(
-					v_i_addr_str_curr,
-					ty_i8->getPointerTo()
-				);
-				instr_out.push_back(v_addr_str_curr);
+			store_string_word(ectx, addr_str_stack, offset, v_word);
 
-				instr_out.push_back(new StoreInst(
-					v_str, v_addr_str_curr, false,
-					mod.getDataLayout().getPrefTypeAlign(ty_i8),
-					(Instruction*)nullptr
-				));
+		}
 
-				++str_begin;
-				--sz_str;
+		Instruction* v_str = new BitCastInst(addr_str_stack, ectx.tys.ty_ptr);
+		ectx.append(v_str);
 
-			}
+		return v_str;
 
-		}
+	}
 
-		instr_out.push_back(
-			new BitCastInst(addr_str_stack, PointerType::get(ctx, 0))
-		);
+	size_t padded_string_size(size_t sz_str) {
 
-		return instr_out;
+		return alignTo(std::max<size_t>(sz_str, 1), SZ_STR_WORD);
 
 	}
 
+	// Equations are generated by other translation units as well
+
+	template insval_t generate_equation<uint8_t>(emit::context&, const std::vector<insval_t>&, size_t);
+	template insval_t generate_equation<uint16_t>(emit::context&, const std::vector<insval_t>&, size_t);
+	template insval_t generate_equation<uint32_t>(emit::context&, const std::vector<insval_t>&, size_t);
+	template insval_t generate_equation<uint64_t>(emit::context&, const std::vector<insval_t>&, size_t);
+
+	template std::vector<Value*> generate_equation_roots<uint8_t>(
+		emit::context&, const std::vector<insval_t>&, size_t, size_t, std::vector<insval_t>&);
+	template std::vector<Value*> generate_equation_roots<uint16_t>(
+		emit::context&, const std::vector<insval_t>&, size_t, size_t, std::vector<insval_t>&);
+	template std::vector<Value*> generate_equation_roots<uint32_t>(
+		emit::context&, const std::vector<insval_t>&, size_t, size_t, std::vector<insval_t>&);
+	template std::vector<Value*> generate_equation_roots<uint64_t>(
+		emit::context&, const std::vector<insval_t>&, size_t, size_t, std::vector<insval_t>&);
+
 }
\ No newline at end of file
@@ -1,18 +1,100 @@
 #include "include/opaque.hpp"
-#include "include/win64_defs.hpp"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/TargetParser/Triple.h"
 
 using namespace llvm;
 
 
+enum class opaque_source_t { AUTO, USER_SHARED_DATA, GLOBAL };
+
+static cl::opt<opaque_source_t> OpaqueSource(
+    "ux-opaque-source",
+    cl::desc("Memory which opaque values are loaded from"),
+    cl::init(opaque_source_t::AUTO),
+    cl::values(
+        clEnumValN(opaque_source_t::AUTO, "auto", "USER_SHARED_DATA on Windows targets, weak global otherwise"),
+        clEnumValN(opaque_source_t::USER_SHARED_DATA, "ushd", "Windows USER_SHARED_DATA"),
+        clEnumValN(opaque_source_t::GLOBAL, "global", "Weak zero-initialized global, works on any target")));
+
+
 namespace opaque {
 
+    namespace {
+
+        constexpr const char* NAME_OPAQUE_GLOBAL = "__ux_opaque_src";
+
+        /* Returns the pointer which opaque values are loaded from. Second byte of the pointed value is zero at runtime,
+            but the compiler can't assume it: USER_SHARED_DATA is only known by Windows, and the weak global may be
+            replaced at link time */
+        Value* get_opaque_source(emit::context& ectx, std::vector<Instruction*>& instr_out) {
+
+            Module& mod = ectx.mod;
+
+            auto int32_ty = ectx.tys.ty_i32;
+
+            bool use_ushd = OpaqueSource == opaque_source_t::USER_SHARED_DATA
+                || (OpaqueSource == opaque_source_t::AUTO && Triple(mod.getTargetTriple()).isOSWindows());
+
+            if (use_ushd) {
+
+                Instruction* v_inttoptr = new IntToPtrInst(ectx.consts.c_addr_ushd, ectx.tys.ty_ptr);
+                instr_out.push_back(v_inttoptr);
+
+                return v_inttoptr;
+
+            }
+
+            GlobalVariable* g_opaque = mod.getNamedGlobal(NAME_OPAQUE_GLOBAL);
+
+            if (!g_opaque) {
+
+                g_opaque = new GlobalVariable(
+                    mod, int32_ty, false /* not constant */,
+                    GlobalValue::WeakAnyLinkage,
+                    ConstantInt::get(int32_ty, 0),
+                    NAME_OPAQUE_GLOBAL);
+
+                g_opaque->setVisibility(GlobalValue::HiddenVisibility);
+
+            }
+
+            return g_opaque;
+
+        }
+
+    }
+
+    bool is_opaque_source(const GlobalValue* gv) {
+
+        return gv->getName() == NAME_OPAQUE_GLOBAL;
+
+    }
+
+    bool is_opaque_load(const emit::context& ectx, const Instruction* inst) {
+
+        const LoadInst* inst_load = dyn_cast<LoadInst>(inst);
+
+        if (!inst_load) return false;
+
+        const Value* v_src = inst_load->getPointerOperand();
+
+        if (const GlobalValue* g_src = dyn_cast<GlobalValue>(v_src))
+            return is_opaque_source(g_src);
+
+        const IntToPtrInst* inst_int_to_ptr = dyn_cast<IntToPtrInst>(v_src);
+
+        return inst_int_to_ptr && inst_int_to_ptr->getOperand(0) == ectx.consts.c_addr_ushd;
+
+    }
+
     std::vector<Instruction*> opaque_by_user_shared_data(
-        Module& mod, uint64_t eq_to, unsigned short sz_eq_bits) {
+        emit::context& ectx, uint64_t eq_to, unsigned short sz_eq_bits) {
 
         assert((sz_eq_bits == 8 || sz_eq_bits == 16 || sz_eq_bits == 32 || sz_eq_bits == 64 )
             && "Argument 'sz_eq_bits' must be one of 8/16/32/64.");
 
-        auto& ctx = mod.getContext();
+        auto& tys = ectx.tys;
 
         /*
         (([7FFE0030] >> 8) & 0xFF) = 0
@@ -20,26 +102,21 @@ namespace opaque {
 
         std::vector<Instruction*> instr_out = {};
 
-        ConstantInt* addr_ushd = ConstantInt::get(
-            Type::getInt64Ty(ctx), ADDR_USER_SHARED_DATA
-            );
-
-        auto int32_ty = Type::getInt32Ty(ctx);
+        auto int32_ty = tys.ty_i32;
 
-        Instruction* v_inttoptr = new IntToPtrInst(addr_ushd, int32_ty->getPointerTo());
-        instr_out.push_back(v_inttoptr);
+        Value* v_src = get_opaque_source(ectx, instr_out);
 
         Instruction* v_ushd = new LoadInst(
-            int32_ty, v_inttoptr, "", false,
-            mod.getDataLayout().getPrefTypeAlign(int32_ty),
+            int32_ty, v_src, "", false,
+            ectx.mod.getDataLayout().getPrefTypeAlign(int32_ty),
             (Instruction*)nullptr
         );
         instr_out.push_back(v_ushd);
 
-        Instruction* v_shr = BinaryOperator::CreateLShr(v_ushd, ConstantInt::get(int32_ty, 8));
+        Instruction* v_shr = BinaryOperator::CreateLShr(v_ushd, ectx.consts.c_opaque_shift);
         instr_out.push_back(v_shr);
 
-        Instruction* v_and = BinaryOperator::CreateAnd(v_shr, ConstantInt::get(int32_ty, 0xFF));
+        Instruction* v_and = BinaryOperator::CreateAnd(v_shr, ectx.consts.c_opaque_mask);
         instr_out.push_back(v_and);
 
         switch (sz_eq_bits) {
@@ -58,7 +135,7 @@ namespace opaque {
                     }
 
                     instr_out.push_back(
-                        new TruncInst(instr_out[instr_out.size() - 1], Type::getInt8Ty(ctx))
+                        new TruncInst(instr_out[instr_out.size() - 1], tys.ty_i8)
                     );
 
                     break;
@@ -78,7 +155,7 @@ namespace opaque {
                     }
 
                     instr_out.push_back(
-                        new TruncInst(instr_out[instr_out.size() - 1], Type::getInt16Ty(ctx))
+                        new TruncInst(instr_out[instr_out.size() - 1], tys.ty_i16)
                     );
 
                     break;
@@ -103,13 +180,13 @@ namespace opaque {
             case 64:
                 {
 
-                    Instruction* v_and_ext = new ZExtInst(v_and, Type::getInt64Ty(ctx));
+                    Instruction* v_and_ext = new ZExtInst(v_and, tys.ty_i64);
                     instr_out.push_back(v_and_ext);
 
                     if (eq_to != 0) {
 
                         instr_out.push_back(
-                            BinaryOperator::CreateAdd(v_and_ext, ConstantInt::get(Type::getInt64Ty(ctx), eq_to))
+                            BinaryOperator::CreateAdd(v_and_ext, ConstantInt::get(tys.ty_i64, eq_to))
                         );
 
                     }
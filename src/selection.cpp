@@ -0,0 +1,276 @@
+#include "include/selection.hpp"
+#include "include/utils.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/raw_ostream.h"
+
+
+using namespace llvm;
+
+
+static cl::opt<std::string> SelectFile(
+    "ux-select-file",
+    cl::desc("Allow/deny regex list deciding which functions and globals are obfuscated"),
+    cl::value_desc("filename"));
+
+
+namespace selection {
+
+    namespace {
+
+        constexpr const char* SECTION_SELECTED = "._obf_sel";
+        constexpr const char* ANNOTATION_PREFIX = "ux";
+
+        /* Reads 'llvm.global.annotations' and merges the kinds of annotations starting with "ux" */
+        void read_annotations(Module& mod, DenseMap<const GlobalValue*, unsigned>& kinds_out) {
+
+            GlobalVariable* g_annotations = mod.getNamedGlobal("llvm.global.annotations");
+
+            if (!g_annotations || !g_annotations->hasInitializer()) return;
+
+            ConstantArray* arr_annotations = dyn_cast<ConstantArray>(g_annotations->getInitializer());
+
+            if (!arr_annotations) return;
+
+            for (Value* op_annotation : arr_annotations->operands()) {
+
+                // { ptr value, ptr annotation, ptr file, i32 line, ptr args }
+                ConstantStruct* st_annotation = dyn_cast<ConstantStruct>(op_annotation);
+
+                if (!st_annotation || st_annotation->getNumOperands() < 2) continue;
+
+                GlobalValue* gv = dyn_cast<GlobalValue>(st_annotation->getOperand(0)->stripPointerCasts());
+                GlobalVariable* g_str = dyn_cast<GlobalVariable>(st_annotation->getOperand(1)->stripPointerCasts());
+
+                if (!gv || !g_str || !g_str->hasInitializer()) continue;
+
+                ConstantDataArray* cdarr_str = dyn_cast<ConstantDataArray>(g_str->getInitializer());
+
+                if (!cdarr_str || !cdarr_str->isCString()) continue;
+
+                StringRef str_annotation = cdarr_str->getAsCString();
+
+                if (!str_annotation.consume_front(ANNOTATION_PREFIX)) continue;
+
+                unsigned kinds = kind::ALL;
+
+                if (!str_annotation.empty()) {
+
+                    if (!str_annotation.consume_front(":")) continue; // belongs to something else, like "uxy"
+
+                    if (!parse_kinds(str_annotation, kinds)) {
+
+                        LOG_WARN("Annotation on (" + gv->getName() + ") has unknown transforms: " + str_annotation);
+
+                        continue;
+
+                    }
+
+                }
+
+                kinds_out[gv] |= kinds;
+
+            }
+
+        }
+
+        /* Reads the allow/deny rules from the file given by '-ux-select-file' and applies them to every global value */
+        void read_select_file(
+            Module& mod,
+            DenseMap<const GlobalValue*, unsigned>& kinds_selected_out,
+            DenseMap<const GlobalValue*, unsigned>& kinds_denied_out) {
+
+            if (SelectFile.empty()) return;
+
+            auto buf_file = MemoryBuffer::getFile(SelectFile);
+
+            if (!buf_file) {
+
+                LOG_ERROR("Selection file (" + SelectFile + ") can't be read: " + buf_file.getError().message());
+
+                return;
+
+            }
+
+            SmallVector<StringRef, 64> lines = {};
+            (*buf_file)->getBuffer().split(lines, '\n', -1, false /* skip empty */);
+
+            for (StringRef line : lines) {
+
+                line = line.trim();
+
+                if (line.empty() || line.starts_with("#")) continue;
+
+                auto [str_rule, str_regex] = line.split(' ');
+
+                auto [str_action, str_kinds] = str_rule.split(':');
+
+                unsigned kinds = kind::ALL;
+
+                if (!str_kinds.empty() && !parse_kinds(str_kinds, kinds)) {
+
+                    LOG_WARN("Selection rule has unknown transforms: " + line);
+
+                    continue;
+
+                }
+
+                DenseMap<const GlobalValue*, unsigned>* kinds_out = nullptr;
+
+                if (str_action == "allow") kinds_out = &kinds_selected_out;
+                else if (str_action == "deny") kinds_out = &kinds_denied_out;
+                else {
+
+                    LOG_WARN("Selection rule must start with allow/deny: " + line);
+
+                    continue;
+
+                }
+
+                // Whole symbol name should be matched
+                Regex re_rule(("^(" + str_regex.trim() + ")$").str());
+
+                std::string err_regex;
+
+                if (!re_rule.isValid(err_regex)) {
+
+                    LOG_WARN("Selection rule has an invalid regex (" + err_regex + "): " + line);
+
+                    continue;
+
+                }
+
+                for (GlobalValue& gv : mod.global_values()) {
+
+                    if (re_rule.match(gv.getName()))
+                        (*kinds_out)[&gv] |= kinds;
+
+                }
+
+            }
+
+        }
+
+    }
+
+    bool parse_kinds(StringRef str_kinds, unsigned& kinds_out) {
+
+        SmallVector<StringRef, 4> names = {};
+        str_kinds.split(names, ',', -1, false /* skip empty */);
+
+        kinds_out = kind::NONE;
+
+        for (StringRef name : names) {
+
+            name = name.trim();
+
+            if (name == "strings") kinds_out |= kind::STRINGS;
+            else if (name == "refs") kinds_out |= kind::REFS;
+            else if (name == "split") kinds_out |= kind::SPLIT;
+            else if (name == "bcf") kinds_out |= kind::BCF;
+            else if (name == "mba") kinds_out |= kind::MBA;
+            else if (name == "pool") kinds_out |= kind::POOL;
+            else if (name == "consts") kinds_out |= kind::CONSTS;
+            else if (name == "all") kinds_out |= kind::ALL;
+            else return false;
+
+        }
+
+        return true;
+
+    }
+
+    selector::selector(Module& mod) : mod(mod) {
+
+        read_annotations(mod, kinds_selected);
+
+        for (GlobalValue& gv : mod.global_values()) {
+
+            if (gv.getSection() == SECTION_SELECTED)
+                kinds_selected[&gv] |= kind::ALL;
+
+        }
+
+        read_select_file(mod, kinds_selected, kinds_denied);
+
+        // Only explicit sources restrict the selection
+        restricted = !kinds_selected.empty();
+
+        for (auto& [gv, kinds] : kinds_selected) {
+
+            if (isa<GlobalVariable>(gv)) kinds_by_globals |= kinds;
+
+        }
+
+        // Callers of _obf_str are already marked by the user for string obfuscation
+        for (Function& fn : mod.functions()) {
+
+            if (fn.getSection() != "._obf_str") continue;
+
+            for (User* fn_user : fn.users()) {
+
+                if (Instruction* inst = dyn_cast<Instruction>(fn_user))
+                    kinds_selected[inst->getFunction()] |= kind::STRINGS;
+
+            }
+
+        }
+
+    }
+
+    bool selector::is_selected(const GlobalValue* gv, kind k) const {
+
+        if (kinds_denied.lookup(gv) & k) return false;
+
+        if (!restricted) return true;
+
+        return kinds_selected.lookup(gv) & k;
+
+    }
+
+    bool selector::is_selected(const Instruction* inst, const GlobalValue* g, kind k) const {
+
+        // Only selected functions pay the runtime cost, whatever globals they use
+        if (!is_selected(inst->getFunction(), k) || (kinds_denied.lookup(g) & k)) return false;
+
+        if (!(kinds_by_globals & k)) return true;
+
+        return kinds_selected.lookup(g) & k;
+
+    }
+
+    size_t selector::count_functions(kind k) const {
+
+        size_t n_selected = 0;
+
+        for (const Function& fn : mod.functions()) {
+
+            if (!fn.isDeclaration() && is_selected(&fn, k))
+                n_selected++;
+
+        }
+
+        return n_selected;
+
+    }
+
+    size_t selector::count_globals(kind k) const {
+
+        size_t n_selected = 0;
+
+        for (const GlobalVariable& glob : mod.globals()) {
+
+            if (glob.hasInitializer() && is_selected(&glob, k))
+                n_selected++;
+
+        }
+
+        return n_selected;
+
+    }
+
+}
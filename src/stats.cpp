@@ -0,0 +1,300 @@
+#include "include/stats.hpp"
+#include "include/utils.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+#define DEBUG_TYPE "ux-obfuscator"
+
+using namespace llvm;
+
+
+STATISTIC(NumInstructionsAdded, "Number of instructions added by obfuscation transforms");
+STATISTIC(NumBlocksAdded, "Number of basic blocks added by obfuscation transforms");
+
+unsigned ux_log_level = LOG_LEVEL_WARN;
+
+static cl::opt<unsigned, true> LogLevel(
+    "ux-log-level",
+    cl::desc("Obfuscator log level (0: none, 1: errors, 2: warnings, 3: info)"),
+    cl::location(ux_log_level));
+
+static cl::opt<std::string> StatsJson(
+    "ux-stats-json",
+    cl::desc("Write a JSON summary of every obfuscation transform with per-function added instruction counts"),
+    cl::value_desc("filename"));
+
+
+namespace stats {
+
+    namespace {
+
+        struct transform_growth {
+            transform_record record;
+            int64_t n_ins_added = 0;
+            int64_t n_bl_added = 0;
+            uint64_t peak_rss_kb = 0;
+            std::vector<std::pair<std::string, int64_t>> fn_ins_added;
+        };
+
+        /* Kept through the process, so the summary covers every transform of the pipeline. It's written once,
+            when the process exits, rather than after every transform */
+        struct summary {
+
+            std::vector<transform_growth> growths = {};
+            std::vector<survival_record> survivals = {};
+            std::vector<std::pair<std::string, std::vector<budget_record>>> budgets = {};
+
+            ~summary();
+
+        };
+
+        summary& get_summary() {
+
+            // errs() is created first, so it's still alive when the summary is written on exit
+            errs();
+
+            static summary smry = {};
+
+            return smry;
+
+        }
+
+        double survival_ratio(const survival_record& record) {
+
+            return record.n_emitted ? static_cast<double>(record.n_surviving) / record.n_emitted : 0;
+
+        }
+
+        void write_json(const summary& smry) {
+
+            std::error_code err_file;
+            raw_fd_ostream out_file(StatsJson, err_file, sys::fs::OF_Text);
+
+            if (err_file) {
+
+                LOG_ERROR("Statistics file (" + StatsJson + ") can't be written: " + err_file.message());
+
+                return;
+
+            }
+
+            json::OStream out_json(out_file, 2);
+
+            out_json.object([&]() {
+
+                out_json.attributeArray("transforms", [&]() {
+
+                    for (const transform_growth& growth : smry.growths) {
+
+                        out_json.object([&]() {
+
+                            out_json.attribute("pass", growth.record.pass_name);
+                            out_json.attribute("time_ms", growth.record.time_ms);
+                            out_json.attribute("functions_selected", static_cast<int64_t>(growth.record.n_fn_selected));
+                            out_json.attribute("globals_selected", static_cast<int64_t>(growth.record.n_g_selected));
+                            out_json.attribute("instructions_added", growth.n_ins_added);
+                            out_json.attribute("blocks_added", growth.n_bl_added);
+                            out_json.attribute("peak_rss_kb", static_cast<int64_t>(growth.peak_rss_kb));
+
+                            out_json.attributeObject("functions", [&]() {
+
+                                for (auto& [fn_name, n_added] : growth.fn_ins_added)
+                                    out_json.attribute(fn_name, n_added);
+
+                            });
+
+                        });
+
+                    }
+
+                });
+
+                if (!smry.budgets.empty()) {
+
+                    out_json.attributeArray("budget", [&]() {
+
+                        for (auto& [pass_name, records] : smry.budgets) {
+
+                            uint64_t n_skipped = 0;
+                            uint64_t n_downgraded = 0;
+
+                            for (const budget_record& record : records) {
+                                n_skipped += record.n_skipped;
+                                n_downgraded += record.n_downgraded;
+                            }
+
+                            out_json.object([&]() {
+
+                                out_json.attribute("pass", pass_name);
+                                out_json.attribute("skipped", static_cast<int64_t>(n_skipped));
+                                out_json.attribute("downgraded", static_cast<int64_t>(n_downgraded));
+
+                                out_json.attributeObject("functions", [&]() {
+
+                                    for (const budget_record& record : records) {
+
+                                        out_json.attributeObject(record.fn_name, [&]() {
+
+                                            out_json.attribute("limit", static_cast<int64_t>(record.n_limit));
+                                            out_json.attribute("spent", static_cast<int64_t>(record.n_spent));
+                                            out_json.attribute("skipped", static_cast<int64_t>(record.n_skipped));
+                                            out_json.attribute("downgraded", static_cast<int64_t>(record.n_downgraded));
+
+                                        });
+
+                                    }
+
+                                });
+
+                            });
+
+                        }
+
+                    });
+
+                }
+
+                if (smry.survivals.empty()) return;
+
+                out_json.attributeArray("survival", [&]() {
+
+                    for (const survival_record& record : smry.survivals) {
+
+                        out_json.object([&]() {
+
+                            out_json.attribute("pass", record.pass_name);
+                            out_json.attribute("emitted", static_cast<int64_t>(record.n_emitted));
+                            out_json.attribute("surviving", static_cast<int64_t>(record.n_surviving));
+                            out_json.attribute("ratio", survival_ratio(record));
+
+                        });
+
+                    }
+
+                });
+
+            });
+
+            out_file << "\n";
+
+        }
+
+        summary::~summary() {
+
+            if (!growths.empty() || !survivals.empty() || !budgets.empty())
+                write_json(*this);
+
+        }
+
+    }
+
+    bool is_enabled() {
+
+        return AreStatisticsEnabled() || !StatsJson.empty() || ux_log_level >= LOG_LEVEL_INFO;
+
+    }
+
+    void take_snapshot(Module& mod, module_snapshot_t& snapshot_out) {
+
+        for (Function& fn : mod.functions()) {
+
+            if (fn.isDeclaration()) continue;
+
+            snapshot_out[fn.getName()] = { fn.getInstructionCount(), static_cast<unsigned>(fn.size()) };
+
+        }
+
+    }
+
+    void record_transform(Module& mod, const module_snapshot_t& before, const transform_record& record) {
+
+        transform_growth growth = {};
+        growth.record = record;
+
+        for (Function& fn : mod.functions()) {
+
+            if (fn.isDeclaration()) continue;
+
+            function_size sz_before = before.lookup(fn.getName()); // zero if function is created by transform
+
+            int64_t n_ins_added = static_cast<int64_t>(fn.getInstructionCount()) - sz_before.n_instructions;
+            int64_t n_bl_added = static_cast<int64_t>(fn.size()) - sz_before.n_blocks;
+
+            growth.n_ins_added += n_ins_added;
+            growth.n_bl_added += n_bl_added;
+
+            if (n_ins_added != 0)
+                growth.fn_ins_added.push_back({ fn.getName().str(), n_ins_added });
+
+        }
+
+        if (growth.n_ins_added > 0) NumInstructionsAdded += growth.n_ins_added;
+        if (growth.n_bl_added > 0) NumBlocksAdded += growth.n_bl_added;
+
+        growth.peak_rss_kb = peak_rss_kb();
+
+        LOG_OK("[" + record.pass_name + "]: Selected " + std::to_string(record.n_fn_selected) + " function(s) and "
+            + std::to_string(record.n_g_selected) + " global(s), added "
+            + std::to_string(growth.n_ins_added) + " instruction(s) and "
+            + std::to_string(growth.n_bl_added) + " block(s), peak RSS "
+            + std::to_string(growth.peak_rss_kb) + " KiB.");
+
+        if (StatsJson.empty()) return;
+
+        get_summary().growths.push_back(std::move(growth));
+
+    }
+
+    uint64_t peak_rss_kb() {
+
+#ifdef LLVM_ON_UNIX
+        struct rusage usage = {};
+
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss) / 1024; // bytes on macOS
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+#else
+        return 0;
+#endif
+
+    }
+
+    void record_survival(const std::vector<survival_record>& records) {
+
+        // Report is what the pass is run for, so it's printed regardless of the log level
+        for (const survival_record& record : records) {
+
+            errs() << "[ux-survival] " << record.pass_name << ": " << record.n_surviving << " of "
+                << record.n_emitted << " instruction(s) left (" << format("%.1f", survival_ratio(record) * 100) << "%)\n";
+
+        }
+
+        if (StatsJson.empty()) return;
+
+        get_summary().survivals = records;
+
+    }
+
+    void record_budget(StringRef pass_name, const std::vector<budget_record>& records) {
+
+        if (StatsJson.empty() || records.empty()) return;
+
+        get_summary().budgets.push_back({ pass_name.str(), records });
+
+    }
+
+}
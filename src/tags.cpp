@@ -0,0 +1,109 @@
+#include "include/tags.hpp"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
+
+
+using namespace llvm;
+
+
+namespace tags {
+
+    void mark(Instruction* inst, StringRef transform) {
+
+        if (inst->getMetadata(MD_OBF)) return; // first transform generating it owns the instruction
+
+        LLVMContext& ctx = inst->getContext();
+
+        inst->setMetadata(MD_OBF, MDNode::get(ctx, MDString::get(ctx, transform)));
+
+    }
+
+    void copy_mark(const Instruction* inst_from, Instruction* inst_to) {
+
+        if (MDNode* md_obf = inst_from->getMetadata(MD_OBF))
+            inst_to->setMetadata(MD_OBF, md_obf);
+
+    }
+
+    StringRef get_mark(const Instruction* inst) {
+
+        MDNode* md_obf = inst->getMetadata(MD_OBF);
+
+        if (!md_obf || md_obf->getNumOperands() < 1) return StringRef();
+
+        MDString* md_str = dyn_cast<MDString>(md_obf->getOperand(0));
+
+        return md_str ? md_str->getString() : StringRef();
+
+    }
+
+    void count_marks(Module& mod, tag_counts_t& counts_out) {
+
+        unsigned md_kind = mod.getContext().getMDKindID(MD_OBF);
+
+        for (Function& fn : mod.functions()) {
+
+            for (BasicBlock& bl : fn) {
+
+                for (Instruction& inst : bl) {
+
+                    if (!inst.hasMetadata()) continue; // cheap check before the lookup
+
+                    MDNode* md_obf = inst.getMetadata(md_kind);
+
+                    if (!md_obf || md_obf->getNumOperands() < 1) continue;
+
+                    if (MDString* md_str = dyn_cast<MDString>(md_obf->getOperand(0)))
+                        counts_out[md_str->getString()]++;
+
+                }
+
+            }
+
+        }
+
+    }
+
+    void set_emitted(Module& mod, const tag_counts_t& counts) {
+
+        LLVMContext& ctx = mod.getContext();
+
+        NamedMDNode* md_emitted = mod.getOrInsertNamedMetadata(MD_EMITTED);
+        md_emitted->clearOperands();
+
+        // { !"ux-refs", i64 N }
+        for (auto& entry : counts) {
+
+            md_emitted->addOperand(MDNode::get(ctx, {
+                MDString::get(ctx, entry.getKey()),
+                ConstantAsMetadata::get(ConstantInt::get(Type::getInt64Ty(ctx), entry.getValue()))
+                }));
+
+        }
+
+    }
+
+    void get_emitted(Module& mod, tag_counts_t& counts_out) {
+
+        NamedMDNode* md_emitted = mod.getNamedMetadata(MD_EMITTED);
+
+        if (!md_emitted) return;
+
+        for (MDNode* md_entry : md_emitted->operands()) {
+
+            if (md_entry->getNumOperands() != 2) continue;
+
+            MDString* md_name = dyn_cast<MDString>(md_entry->getOperand(0));
+            ConstantAsMetadata* md_count = dyn_cast<ConstantAsMetadata>(md_entry->getOperand(1));
+
+            if (!md_name || !md_count) continue;
+
+            if (ConstantInt* c_count = dyn_cast<ConstantInt>(md_count->getValue()))
+                counts_out[md_name->getString()] = c_count->getZExtValue();
+
+        }
+
+    }
+
+}
@@ -0,0 +1,1802 @@
+#include "include/transforms.hpp"
+#include "include/budget.hpp"
+#include "include/emit.hpp"
+#include "include/encoder.h"
+#include "include/irmanager.h"
+#include "include/mba.hpp"
+#include "include/obfmath.hpp"
+#include "include/opaque.hpp"
+#include "include/tags.hpp"
+#include "include/utils.h"
+#include "include/utils.hpp"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <optional>
+
+
+#define DEBUG_TYPE "ux-obfuscator"
+
+using namespace llvm;
+
+
+STATISTIC(NumStringsObfuscated, "Number of string literals obfuscated");
+STATISTIC(NumStringsEncoded, "Number of string literals encoded to be decoded at startup");
+STATISTIC(NumSharedDecodersCreated, "Number of linkonce_odr string decoders created");
+STATISTIC(NumReferencesRewritten, "Number of global references rewritten");
+STATISTIC(NumPointerChainsCanonicalized, "Number of ptrtoint/inttoptr round trips rewritten to GEPs");
+STATISTIC(NumMBARewrites, "Number of integer operations rewritten into MBA forms");
+STATISTIC(NumMBAOverBudget, "Number of integer operations left as is since no MBA form fits the budget");
+STATISTIC(NumPoolGlobals, "Number of constant aggregates moved into the encrypted pool");
+STATISTIC(NumPoolBytes, "Number of bytes in the encrypted constant pool");
+STATISTIC(NumConstantsHidden, "Number of integer constants replaced with offsets of opaque equations");
+
+
+namespace transforms {
+
+namespace {
+
+void create_decode_function(emit::context& ectx, Function* &function_out) {
+
+	// Declare and initialize function prototype
+
+	Module& mod = ectx.mod;
+	auto &ctx = mod.getContext();
+	auto &tys = ectx.tys;
+	auto &builder = ectx.builder;
+
+	auto ty_ptr_str = tys.ty_ptr;
+	auto ty_key = tys.ty_i8;
+	auto ty_sz_str = tys.ty_i64;
+
+	std::vector<Type*> ty_args = {
+		ty_ptr_str,
+		ty_key,
+		ty_sz_str
+		};
+
+
+	Function* dec_fn = Function::Create(
+		FunctionType::get(tys.ty_void, ty_args, false),
+		GlobalValue::LinkageTypes::ExternalLinkage,
+		"obf_decode",
+		mod
+		);
+
+	dec_fn->addFnAttr(Attribute::get(
+		ctx,
+		Attribute::AlwaysInline
+		)); // Always inline this function
+
+	dec_fn->setCallingConv(CallingConv::C);
+			
+
+	auto args = dec_fn->arg_begin();
+
+	Value* arg_ptr_str = args++;
+	arg_ptr_str->setName("ptr_str");
+
+	Value* arg_key = args++;
+	arg_key->setName("key");
+	
+	Value* arg_sz_str = args++;
+	arg_sz_str->setName("sz_str");
+
+
+	// Start defining function and filling it with instructions
+
+	/*
+
+	entry:
+
+		%i0 = alloca i64
+
+		store i64 0, i64* %i0
+
+		br label %repeat
+
+	repeat:
+
+		%i0tmp = load i64, i64* %i0
+
+		%cond = icmp ugt %szStr, %i0tmp
+
+		br i1 %cond, label %decode, label %end
+
+	decode:
+
+		%arg_ptr_str_int = ptrtoint i8* arg_ptr_str to i64
+
+		%ptr_char_int = add i64 arg_ptr_str_int, %i0tmp
+
+		%ptr_char = inttoptr i64 %ptr_char_int to i8*
+
+		%e_val = load i8, i8* %ptr_char
+
+		%d_val = xor i8 %e_val, i8 %key
+
+		store i8 %d_val, i8* %ptr_char
+
+		%i0tmp2 = add i64 %i0tmp, i64 1
+
+		store i64 %i0tmp2, i64* %i0 
+
+		br label repeat
+
+	end:
+
+		ret
+
+	*/
+
+	BasicBlock* bl_entry = BasicBlock::Create(
+		ctx, "entry", dec_fn
+		); /* entry block */
+
+	BasicBlock* bl_repeat = BasicBlock::Create(
+		ctx, "repeat", dec_fn
+		); /* repeat block */
+
+	BasicBlock* bl_decode = BasicBlock::Create(
+		ctx, "decode", dec_fn
+		); /* decode block */
+
+	BasicBlock* bl_end = BasicBlock::Create(
+		ctx, "end", dec_fn
+		); /* end block */
+
+
+	// Create entry block instructions
+
+	builder.SetInsertPoint(bl_entry);
+
+	auto var_i0 = builder.CreateAlloca(
+		tys.ty_i64,
+		nullptr /* not an array */,
+		"i0"
+		); // %i0 = alloca i64
+
+	builder.CreateStore(
+		ConstantInt::get(tys.ty_i64, 0),
+		var_i0
+		); // store i64 0, i64* %i0
+			
+	builder.CreateBr(bl_repeat); // br label %repeat
+
+	
+	// Create repeat block instructions
+
+	builder.SetInsertPoint(bl_repeat);
+
+	auto var_i0tmp = builder.CreateLoad(
+		tys.ty_i64,
+		var_i0,
+		"i0tmp"
+		); // %i0tmp = load i64, i64* %i0
+
+	auto var_cond = builder.CreateICmpUGT(
+		arg_sz_str,
+		var_i0tmp,
+		"cond"
+		); // %cond = icmp ugt %szStr, %i0tmp
+
+	builder.CreateCondBr(
+		var_cond,
+		bl_decode,
+		bl_end
+		); // br i1 %cond, label %decode, label %end
+
+	
+	// Create decode block instructions
+
+	builder.SetInsertPoint(bl_decode);
+
+	auto var_arg_ptr_str_int = builder.CreatePtrToInt(
+		arg_ptr_str,
+		tys.ty_i64,
+		"arg_ptr_str_int"
+		); // %arg_ptr_str_int = ptrtoint i8* arg_ptr_str to i64
+
+	auto var_ptr_char_int = builder.CreateAdd(
+		var_arg_ptr_str_int,
+		var_i0tmp,
+		"ptr_char_int"
+		); // %ptr_char_int = add i64 arg_ptr_str_int, %i0tmp
+
+	auto var_ptr_char = builder.CreateIntToPtr(
+		var_ptr_char_int,
+		tys.ty_ptr,
+		"ptr_char"
+		); // %ptr_char = inttoptr i64 %ptr_char_int to i8*
+
+	auto var_e_val = builder.CreateLoad(
+		tys.ty_i8,
+		var_ptr_char,
+		"e_val"
+		); // %e_val = load i8, i8* %ptr_char
+
+	auto var_d_val = builder.CreateXor(
+		var_e_val,
+		arg_key,
+		"d_val"
+		); // %d_val = xor i8 %e_val, i8 %key
+
+	builder.CreateStore(
+		var_d_val,
+		var_ptr_char
+		); // store i8 %d_val, i8* %ptr_char
+
+	auto var_i0tmp2 = builder.CreateAdd(
+		var_i0tmp,
+		ConstantInt::get(tys.ty_i64, 1),
+		"i0tmp2"
+		); // %i0tmp2 = add i64 %i0tmp, i64 1
+
+	builder.CreateStore(
+		var_i0tmp2,
+		var_i0
+		); // store i64 %i0tmp2, i64* %i0
+
+	builder.CreateBr(bl_repeat); // br label repeat
+
+
+	// Create end block instructions
+
+	builder.SetInsertPoint(bl_end);
+
+	builder.CreateRetVoid(); // ret
+
+	function_out = dec_fn;
+
+}
+
+std::vector<GlobalVariable*> encode_string_literals(emit::context& ectx, const selection::selector& sel) {
+
+    Module& mod = ectx.mod;
+
+    std::vector<GlobalVariable*> g_strings = {};
+
+    // First get string globals passed to _obf_str
+
+    std::vector<std::pair<CallInst*, GlobalVariable*>> obf_calls = {};
+    collect_obf_str_calls(mod, sel, obf_calls);
+
+    SmallPtrSet<GlobalVariable*, 16> g_visited = {};
+
+    for (auto& [_, _g] : obf_calls) {
+
+        if (!g_visited.insert(_g).second) continue; // literal is passed more than once
+
+        auto const_data_arr = cast<ConstantDataArray>(_g->getInitializer());
+
+        // Then this value is exactly what we need
+
+        StringRef str_ref_data = const_data_arr->getAsString();
+
+        const char* data = str_ref_data.begin();
+        const size_t sz_data = str_ref_data.size();
+
+        // Buffer is reused by every literal, initializer keeps its own copy
+        auto& buf_encoded = ectx.buf_bytes;
+        buf_encoded.resize(sz_data);
+
+        encoder::encode_c_string(data, buf_encoded.data(), 0xAF, sz_data);
+
+        Constant* const_encoded = ConstantDataArray::getString(
+            mod.getContext(), StringRef(buf_encoded.data(), sz_data), false /* no null terminator */);
+
+        _g->setInitializer(const_encoded);
+        g_strings.push_back(_g);
+        _g->setConstant(false /* not constant */);
+
+        NumStringsEncoded++;
+
+    }
+
+    return g_strings;
+
+}
+
+bool decode_string_literals_at_startup(emit::context& ectx, const selection::selector& sel) {
+
+    Module& mod = ectx.mod;
+    auto& ctx = mod.getContext();
+    auto& tys = ectx.tys;
+
+    Function* fn_main = mod.getFunction("main");
+
+    if (!fn_main || fn_main->isDeclaration()) {
+
+        LOG_WARN("No 'main' is defined in module, string literals can't be decoded at startup.");
+
+        return false;
+
+    }
+
+    auto g_strings = encode_string_literals(ectx, sel);
+
+    if (g_strings.empty()) return false;
+
+    // Create decode function
+
+    Function* fn_decode;
+    create_decode_function(ectx, fn_decode);
+
+    for (Instruction& inst : instructions(*fn_decode))
+        tags::mark(&inst, "ux-strings");
+
+
+    // Add calls to decode function for every encoded string
+
+    BasicBlock* bl_dec_stub = BasicBlock::Create(
+        ctx,
+        "obf_decode_stub"
+        );
+
+    ectx.builder.SetInsertPoint(bl_dec_stub);
+
+    for (GlobalVariable* g_string : g_strings) {
+
+        Value* args[] = {
+            g_string, // arg_ptr_str
+            ConstantInt::get(
+                tys.ty_i8,
+                0xAF,
+                false /* not signed */
+            ), // arg_key
+            ConstantInt::get(
+                tys.ty_i64,
+                cast<ConstantDataArray>(g_string->getInitializer())->getAsString().size()
+            ) // arg_sz_str
+            };
+
+        ectx.builder.CreateCall(fn_decode, args);
+
+    }
+
+    ir_manager::module::set_function_hook(bl_dec_stub, fn_main);
+
+    for (Instruction& inst : *bl_dec_stub)
+        tags::mark(&inst, "ux-strings");
+
+    return true;
+
+}
+
+/* Block splitting only adds branches, so every terminator which wasn't there before is generated */
+void collect_terminators(Function& fn, SmallPtrSetImpl<Instruction*>& terms_out) {
+
+	for (BasicBlock& bl : fn) {
+
+		if (Instruction* inst_term = bl.getTerminator())
+			terms_out.insert(inst_term);
+
+	}
+
+}
+
+void mark_new_terminators(Function& fn, const SmallPtrSetImpl<Instruction*>& terms_before, StringRef transform) {
+
+	for (BasicBlock& bl : fn) {
+
+		Instruction* inst_term = bl.getTerminator();
+
+		if (inst_term && !terms_before.count(inst_term))
+			tags::mark(inst_term, transform);
+
+	}
+
+}
+
+/*
+Estimated growth of a single 'split_blocks_once' over 'fn', a branch per cut. Cuts land at random before
+the part left is cut again, so a block of N instructions is cut about log(N) times.
+*/
+size_t estimate_split_growth(Function& fn) {
+
+	size_t n_growth = 0;
+
+	for (BasicBlock& bl : fn) {
+
+		size_t n_ins = std::distance(bl.getFirstInsertionPt(), bl.end());
+
+		if (n_ins >= 3) n_growth += Log2_64_Ceil(n_ins);
+
+	}
+
+	return n_growth;
+
+}
+
+/* How many of the 'times' splits of 'fn' fit its budget, the ones which don't are skipped */
+unsigned short get_split_times_within_budget(budget::tracker& budget, Function& fn, unsigned short times) {
+
+	if (!budget.is_enabled()) return times;
+
+	size_t n_growth = estimate_split_growth(fn);
+
+	size_t n_fit = n_growth ? std::min<size_t>(times, budget.remaining(fn) / n_growth) : times;
+
+	if (n_fit == 0) budget.skip(fn);
+	else if (n_fit < times) budget.downgrade(fn);
+
+	return static_cast<unsigned short>(n_fit);
+
+}
+
+/* String literal passed to a call of a '._obf_str' function, null if it isn't one */
+GlobalVariable* get_obf_str_literal(CallInst* instr_call) {
+
+	Function* fn_called = instr_call->getCalledFunction();
+
+	if (!fn_called
+		|| fn_called->getSection() != "._obf_str"
+		|| instr_call->arg_size() < 1) return nullptr;
+
+	// Argument may be wrapped with casts or zero-index GEPs on typed pointers
+
+	GlobalVariable* g_str = dyn_cast<GlobalVariable>(
+		instr_call->getArgOperand(0)->stripPointerCasts());
+
+	if (!g_str || !g_str->hasInitializer()) return nullptr;
+
+	ConstantDataArray* cdarr_init = dyn_cast<ConstantDataArray>(g_str->getInitializer());
+
+	// Check if global is not a string
+
+	if (!cdarr_init || !cdarr_init->isString()) return nullptr;
+
+	return g_str;
+
+}
+
+/* Appends the instructions rebuilding 'str' on stack in the encoding picked by 'opts' */
+Value* rebuild_string_literal(emit::context& ectx, StringRef str, const strings_options& opts) {
+
+	if (opts.encoding == strings_encoding::KEYSTREAM)
+		return math::obfuscate_string_literal_keystream(ectx, str, opts.depth);
+
+	return math::obfuscate_string_literal(ectx, str, opts.depth);
+
+}
+
+/*
+Returns the decoder rebuilding 'str' into the buffer passed as its argument, creating it if needed.
+Decoder is named after the hash of the literal and its body is emitted with the random engine seeded
+by the same hash, so every module using the literal defines the very same linkonce_odr function. The
+linker (or the thin link of ThinLTO, which imports the prevailing copy) keeps only one of them.
+*/
+Function* get_shared_decoder(emit::context& ectx, StringRef str, const strings_options& opts) {
+
+	Module& mod = ectx.mod;
+	auto& ctx = mod.getContext();
+
+	uint64_t hash_str = xxHash64(str);
+
+	SmallString<32> name_decoder = {};
+	raw_svector_ostream(name_decoder) << "__ux_str." << format_hex_no_prefix(hash_str, 16);
+
+	if (Function* fn_decoder = mod.getFunction(name_decoder)) return fn_decoder;
+
+	FunctionType* ty_decoder = FunctionType::get(
+		ectx.tys.ty_void, { ectx.tys.ty_ptr }, false);
+
+	Function* fn_decoder = Function::Create(
+		ty_decoder, GlobalValue::LinkOnceODRLinkage, name_decoder, mod);
+
+	fn_decoder->setVisibility(GlobalValue::HiddenVisibility);
+	fn_decoder->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+	fn_decoder->addFnAttr(Attribute::NoInline); // inlining would bring back a copy per call site
+	fn_decoder->addFnAttr(Attribute::NoUnwind);
+
+	if (Triple(mod.getTargetTriple()).supportsCOMDAT())
+		fn_decoder->setComdat(mod.getOrInsertComdat(name_decoder));
+
+	BasicBlock* bl_entry = BasicBlock::Create(ctx, "entry", fn_decoder);
+	Instruction* inst_ret = ReturnInst::Create(ctx, bl_entry);
+
+	Value* v_str = nullptr;
+
+	{
+
+		random_seed_scope seed(hash_str ^ opts.depth);
+
+		v_str = rebuild_string_literal(ectx, str, opts);
+
+	}
+
+	ectx.splice_before(inst_ret, "ux-strings");
+
+	tags::mark(inst_ret, "ux-strings");
+
+	// Literal is rebuilt right into the caller's buffer instead of the stack of the decoder
+
+	Instruction* inst_str_cast = cast<Instruction>(v_str);
+	Instruction* addr_str_stack = cast<AllocaInst>(inst_str_cast->getOperand(0));
+
+	inst_str_cast->eraseFromParent();
+
+	addr_str_stack->replaceAllUsesWith(fn_decoder->getArg(0));
+	addr_str_stack->eraseFromParent();
+
+	NumSharedDecodersCreated++;
+
+	return fn_decoder;
+
+}
+
+/* Replaces a single _obf_str call with a buffer filled by the shared decoder of its literal, which costs
+	the caller an alloca and a call. Returns false if the call is left as is since even that doesn't fit */
+bool share_string_call(
+	emit::context& ectx, budget::tracker& budget, CallInst* instr_call, GlobalVariable* g_str, const strings_options& opts) {
+
+	Function& fn = *instr_call->getFunction();
+
+	if (!budget.try_spend(fn, 2)) {
+
+		budget.skip(fn);
+
+		return false;
+
+	}
+
+	StringRef str_init = cast<ConstantDataArray>(g_str->getInitializer())->getAsString();
+
+	Function* fn_decoder = get_shared_decoder(ectx, str_init, opts);
+
+	// Decoder stores the literal in whole 8-byte words
+	Instruction* addr_str = new AllocaInst(
+		ectx.tys.ty_i8, ectx.mod.getDataLayout().getAllocaAddrSpace(),
+		ConstantInt::get(ectx.tys.ty_i64, math::padded_string_size(str_init.size())),
+		Align(8), "", instr_call);
+
+	Instruction* inst_decode = CallInst::Create(fn_decoder, { addr_str }, "", instr_call);
+
+	tags::mark(addr_str, "ux-strings");
+	tags::mark(inst_decode, "ux-strings");
+
+	instr_call->replaceAllUsesWith(addr_str);
+
+	instr_call->eraseFromParent();
+
+	NumStringsObfuscated++;
+
+	return true;
+
+}
+
+/*
+Replaces a single _obf_str call with the string rebuilt by opaque equations. If the rebuild doesn't fit
+the budget of the caller, it's downgraded to the keystream encoding, then to a call to the shared decoder.
+*/
+void obfuscate_string_call(
+	emit::context& ectx, budget::tracker& budget, CallInst* instr_call, GlobalVariable* g_str, const strings_options& opts) {
+
+	if (opts.mode == strings_mode::SHARED) {
+
+		share_string_call(ectx, budget, instr_call, g_str, opts);
+
+		return;
+
+	}
+
+	Function& fn = *instr_call->getFunction();
+
+	StringRef str_init = cast<ConstantDataArray>(g_str->getInitializer())->getAsString();
+
+	strings_options opts_call = opts;
+
+	while (true) {
+
+		Value* v_str = rebuild_string_literal(ectx, str_init, opts_call);
+
+		if (budget.try_spend(fn, ectx.bl_scratch->size())) {
+
+			ectx.splice_before(instr_call, "ux-strings");
+
+			instr_call->replaceAllUsesWith(v_str);
+
+			instr_call->eraseFromParent();
+
+			if (opts_call.encoding != opts.encoding) budget.downgrade(fn);
+
+			NumStringsObfuscated++;
+
+			return;
+
+		}
+
+		ectx.discard();
+
+		if (opts_call.encoding == strings_encoding::KEYSTREAM) break;
+
+		opts_call.encoding = strings_encoding::KEYSTREAM;
+
+	}
+
+	// Decoder is out of line, whatever it costs doesn't count for the caller
+	if (share_string_call(ectx, budget, instr_call, g_str, opts)) budget.downgrade(fn);
+
+}
+
+/* Literals which are still used in their plain form can't be removed */
+void erase_literal_if_unused(GlobalVariable* g_str) {
+
+	g_str->removeDeadConstantUsers();
+
+	if (!g_str->use_empty() || !g_str->hasLocalLinkage()) return; // used non-obfuscated
+
+	g_str->eraseFromParent();
+
+}
+
+/*
+Whether the use of 'glob' by 'inst_user' can be replaced by a rebuilt pointer. EH pads have to lead their block
+and take their clauses as they are, the address of a thread-local global is only taken by llvm.threadlocal.address.
+*/
+bool is_reference_rewritable(const Instruction* inst_user, const GlobalVariable* glob) {
+
+	return !inst_user->isEHPad() && !glob->isThreadLocal();
+
+}
+
+/*
+Where the pointer replacing 'glob' in the incoming values of 'phi' is rebuilt: end of the latest block dominating
+every incoming block it comes from. The pointer is read on the edges, so it can't be rebuilt before the PHI itself.
+A block ending with a catchswitch holds nothing else, the pointer is rebuilt above it then.
+*/
+Instruction* get_incoming_insertion_point(PHINode* phi, GlobalVariable* glob, DominatorTree& dt) {
+
+	BasicBlock* bl_common = nullptr;
+
+	for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i) {
+
+		BasicBlock* bl_incoming = phi->getIncomingBlock(i);
+
+		if (phi->getIncomingValue(i) != glob || !dt.isReachableFromEntry(bl_incoming)) continue;
+
+		bl_common = bl_common ? dt.findNearestCommonDominator(bl_common, bl_incoming) : bl_incoming;
+
+	}
+
+	// Anything dominates edges from unreachable blocks
+	if (!bl_common) bl_common = &phi->getFunction()->getEntryBlock();
+
+	while (bl_common->getTerminator()->isEHPad())
+		bl_common = dt.getNode(bl_common)->getIDom()->getBlock();
+
+	return bl_common->getTerminator();
+
+}
+
+/*
+Hides the use of 'glob' by 'inst_user' behind an offset which is removed by 'root' of an opaque equation.
+Pointer is rebuilt right before 'inst_pos', which is 'inst_user' itself unless it's a PHI.
+*/
+void rewrite_reference(
+	emit::context& ectx, Instruction* inst_user, Instruction* inst_pos, GlobalVariable* glob, const math::insval_t& root) {
+
+	IntegerType* ty_i32 = ectx.tys.ty_i32;
+	IntegerType* ty_i64 = ectx.tys.ty_i64;
+
+	Instruction* inst_base = GetElementPtrInst::Create(
+		ectx.tys.ty_i8, glob, ConstantInt::get(ty_i32, 0x123456));
+	ectx.append(inst_base);
+
+	ectx.append(root.first);
+
+	uint32_t gap = 0x123456 - (uint32_t)root.second;
+	Value* val_gap = ConstantInt::get(ty_i32, gap);
+
+	Instruction* inst_add_gap =
+		BinaryOperator::CreateAdd(root.first.back(), val_gap);
+	ectx.append(inst_add_gap);
+
+	// inst_add_gap == 0x123456
+
+	Instruction* inst_ptr_to_int = new PtrToIntInst(inst_base, ty_i64);
+	ectx.append(inst_ptr_to_int);
+
+	Instruction* inst_zext_to_i64 = new ZExtInst(inst_add_gap, ty_i64);
+	ectx.append(inst_zext_to_i64);
+
+	Instruction* inst_sub_gap =
+		BinaryOperator::CreateSub(inst_ptr_to_int, inst_zext_to_i64);
+	ectx.append(inst_sub_gap);
+
+	Instruction* inst_ptr_new =
+		new IntToPtrInst(inst_sub_gap, ectx.tys.ty_ptr);
+	ectx.append(inst_ptr_new);
+
+	ectx.splice_before(inst_pos, "ux-refs");
+
+	// Every incoming value of a PHI taking 'glob' comes from a block dominated by 'inst_pos'
+	inst_user->replaceUsesOfWith(glob, inst_ptr_new);
+
+	NumReferencesRewritten++;
+
+}
+
+/*
+Latest point dominating every instruction of 'users' outside of loops, where an equation shared by them is
+emitted. Its values are then live only from there on instead of from the entry of 'fn', and it still runs
+once per call. A PHI user reads its operand on the edge, so the entry is returned for it.
+EH pads have to lead their block (a catchswitch block holds nothing else), so the equation is placed above them.
+*/
+Instruction* get_shared_insertion_point(Function& fn, ArrayRef<Instruction*> users) {
+
+	Instruction* inst_entry = &*fn.getEntryBlock().getFirstInsertionPt();
+
+	DominatorTree dt(fn);
+
+	BasicBlock* bl_common = nullptr;
+
+	for (Instruction* inst_user : users) {
+
+		if (isa<PHINode>(inst_user)) return inst_entry;
+
+		BasicBlock* bl_user = inst_user->getParent();
+
+		if (!dt.isReachableFromEntry(bl_user)) continue; // anything dominates an unreachable use
+
+		bl_common = bl_common ? dt.findNearestCommonDominator(bl_common, bl_user) : bl_user;
+
+	}
+
+	if (!bl_common) return inst_entry;
+
+	// Header of a loop is dominated by the block entering it, which runs once
+	LoopInfo li(dt);
+
+	while (true) {
+
+		if (Loop* loop = li.getLoopFor(bl_common)) {
+
+			bl_common = dt.getNode(loop->getHeader())->getIDom()->getBlock();
+
+		} else if (bl_common->isEHPad()) {
+
+			DomTreeNode* node_idom = dt.getNode(bl_common)->getIDom();
+
+			if (!node_idom) return inst_entry;
+
+			bl_common = node_idom->getBlock();
+
+		} else break;
+
+	}
+
+	Instruction* inst_first = nullptr;
+
+	for (Instruction* inst_user : users)
+		if (inst_user->getParent() == bl_common && (!inst_first || inst_user->comesBefore(inst_first)))
+			inst_first = inst_user;
+
+	// Start of the block rather than its end, where a terminator may have to follow a musttail call
+	return inst_first ? inst_first : &*bl_common->getFirstInsertionPt();
+
+}
+
+/*
+Calls 'emit_roots(n, roots_out)' to append the equation shared by the items of 'fn' to the scratch block, with
+a root for as many of its 'n_items' as fit the budget, each root costing 'n_item_insts' more where it's used.
+Count is cut down by what's left of the budget until it fits, so the first items are kept.
+Returns how many roots are emitted, the scratch block is left empty if it's none.
+*/
+template <typename emit_roots_cb_t>
+size_t emit_roots_within_budget(
+	emit::context& ectx, budget::tracker& budget, Function& fn, size_t n_items, size_t n_item_insts,
+	std::vector<math::insval_t>& roots_out, emit_roots_cb_t emit_roots) {
+
+	size_t n_roots = n_items;
+
+	while (n_roots > 0) {
+
+		roots_out.clear();
+
+		emit_roots(n_roots, roots_out);
+
+		size_t n_insts = ectx.bl_scratch->size();
+
+		for (math::insval_t& root : roots_out)
+			n_insts += root.first.size() + n_item_insts;
+
+		if (budget.try_spend(fn, n_insts)) break;
+
+		// Roots aren't appended yet, they're dropped together with the equation
+		for (math::insval_t& root : roots_out)
+			ectx.append(root.first);
+
+		ectx.discard();
+
+		roots_out.clear();
+
+		n_roots = std::min(n_roots - 1, n_roots * budget.remaining(fn) / n_insts);
+
+	}
+
+	if (n_roots < n_items) budget.skip(fn, n_items - n_roots);
+
+	return n_roots;
+
+}
+
+/* Appends the 32-bit equation shared by the references of a function, with 'n_roots' roots */
+void emit_references_equation(emit::context& ectx, size_t depth, size_t n_roots, std::vector<math::insval_t>& roots_out) {
+
+	std::vector<Instruction*> ins_opq_1 =
+		opaque::opaque_by_user_shared_data(ectx, 0x100000, 32);
+
+	math::insval_t insv_opq_1 = { std::vector<Value*>(
+		ins_opq_1.begin(), ins_opq_1.end()
+	), 0x100000 };
+
+	std::vector<Instruction*> ins_opq_2 =
+		opaque::opaque_by_user_shared_data(ectx, 0xFFFFFF, 32);
+
+	math::insval_t insv_opq_2 = { std::vector<Value*>(
+		ins_opq_2.begin(), ins_opq_2.end()
+	), 0xFFFFFF };
+
+	ectx.append(math::generate_equation_roots<uint32_t>(
+		ectx, { insv_opq_1, insv_opq_2 }, depth, n_roots, roots_out));
+
+}
+
+/*
+Rewrites 'refs', whose users are all in 'fn'. One equation is emitted for all of them where it dominates
+every user, then each reference takes its own root of it right before its user, or at the end of the incoming
+blocks for a PHI. References which don't fit the budget of 'fn' are left as they are.
+*/
+void rewrite_function_references(
+	emit::context& ectx, budget::tracker& budget, Function& fn,
+	ArrayRef<std::pair<Instruction*, GlobalVariable*>> refs, const refs_options& opts) {
+
+	std::vector<math::insval_t> roots = {};
+
+	// Base GEP, the gap, ptrtoint, zext, sub and inttoptr around each root
+	size_t n_refs = emit_roots_within_budget(ectx, budget, fn, refs.size(), 6, roots,
+		[&](size_t n_roots, std::vector<math::insval_t>& roots_out) {
+			emit_references_equation(ectx, opts.depth, n_roots, roots_out);
+		});
+
+	if (n_refs == 0) return;
+
+	std::vector<Instruction*> positions = {};
+
+	// Dominator tree is only needed to place the pointers read by PHIs
+	std::optional<DominatorTree> dt = std::nullopt;
+
+	for (auto& [inst_user, glob] : refs.take_front(n_refs)) {
+
+		PHINode* phi = dyn_cast<PHINode>(inst_user);
+
+		if (phi && !dt) dt.emplace(fn);
+
+		positions.push_back(phi ? get_incoming_insertion_point(phi, glob, *dt) : inst_user);
+
+	}
+
+	ectx.splice_before(get_shared_insertion_point(fn, positions), "ux-refs");
+
+	for (size_t i = 0; i < n_refs; ++i)
+		rewrite_reference(ectx, refs[i].first, positions[i], refs[i].second, roots[i]);
+
+}
+
+/* Odd step of the Weyl sequence which pool words are masked by, every word index gets its own counter */
+constexpr uint64_t POOL_WEYL_STEP = 0x9E3779B97F4A7C15;
+
+/* Mask of the pool word at 'idx_word', must match the loop emitted by 'create_pool_decoder' */
+constexpr uint64_t pool_word_mask(uint64_t seed, uint64_t idx_word) {
+
+	uint64_t x = seed + idx_word * POOL_WEYL_STEP;
+
+	x ^= x >> 29;
+	x ^= x << 17;
+
+	return x;
+
+}
+
+/* Writes 'val' to 'buf' in the byte order of the target, zero extended to the size of 'buf' */
+void write_integer_bytes(const DataLayout& dl, const APInt& val, MutableArrayRef<char> buf) {
+
+	for (size_t i = 0; i < buf.size(); ++i) {
+
+		unsigned pos_bit = i * 8;
+
+		uint64_t val_byte = pos_bit < val.getBitWidth()
+			? val.extractBitsAsZExtValue(std::min(8u, val.getBitWidth() - pos_bit), pos_bit)
+			: 0;
+
+		buf[dl.isBigEndian() ? buf.size() - 1 - i : i] = static_cast<char>(val_byte);
+
+	}
+
+}
+
+/* Reads up to 8 bytes of 'buf' as an integer in the byte order of the target */
+uint64_t read_integer_bytes(const DataLayout& dl, ArrayRef<char> buf) {
+
+	uint64_t val = 0;
+
+	for (size_t i = 0; i < buf.size(); ++i) {
+
+		uint64_t val_byte = static_cast<unsigned char>(buf[dl.isBigEndian() ? buf.size() - 1 - i : i]);
+
+		val |= val_byte << (8 * i);
+
+	}
+
+	return val;
+
+}
+
+/*
+Writes the memory image of 'init' to 'buf', which is zero filled and as large as its store size.
+Returns false if 'init' holds anything which isn't known before link time, like an address.
+*/
+bool write_constant_bytes(const DataLayout& dl, const Constant* init, MutableArrayRef<char> buf) {
+
+	if (isa<ConstantAggregateZero>(init) || isa<UndefValue>(init)) return true; // buffer is already zero
+
+	if (auto c_int = dyn_cast<ConstantInt>(init)) {
+
+		write_integer_bytes(dl, c_int->getValue(), buf);
+
+		return true;
+
+	}
+
+	if (auto c_fp = dyn_cast<ConstantFP>(init)) {
+
+		write_integer_bytes(dl, c_fp->getValueAPF().bitcastToAPInt(), buf);
+
+		return true;
+
+	}
+
+	Type* ty = init->getType();
+
+	if (auto ty_struct = dyn_cast<StructType>(ty)) {
+
+		const StructLayout* layout = dl.getStructLayout(ty_struct);
+
+		for (unsigned i = 0; i < ty_struct->getNumElements(); ++i) {
+
+			const Constant* c_elem = init->getAggregateElement(i);
+
+			if (!c_elem || !write_constant_bytes(dl, c_elem, buf.slice(
+				layout->getElementOffset(i), dl.getTypeStoreSize(c_elem->getType())))) return false;
+
+		}
+
+		return true;
+
+	}
+
+	Type* ty_elem = nullptr;
+	uint64_t n_elems = 0;
+
+	if (auto ty_arr = dyn_cast<ArrayType>(ty)) {
+
+		ty_elem = ty_arr->getElementType();
+		n_elems = ty_arr->getNumElements();
+
+	} else if (auto ty_vec = dyn_cast<FixedVectorType>(ty)) {
+
+		ty_elem = ty_vec->getElementType();
+		n_elems = ty_vec->getNumElements();
+
+		// Elements of vectors like <8 x i1> are packed into bits
+		if (dl.getTypeSizeInBits(ty_elem) != dl.getTypeAllocSizeInBits(ty_elem)) return false;
+
+	} else return false; // addresses and constant expressions are only resolved by the linker
+
+	uint64_t sz_elem = dl.getTypeAllocSize(ty_elem);
+	uint64_t sz_elem_store = dl.getTypeStoreSize(ty_elem);
+
+	for (uint64_t i = 0; i < n_elems; ++i) {
+
+		const Constant* c_elem = init->getAggregateElement(i);
+
+		if (!c_elem || !write_constant_bytes(dl, c_elem, buf.slice(i * sz_elem, sz_elem_store))) return false;
+
+	}
+
+	return true;
+
+}
+
+/* Whether 'glob' is an internal constant aggregate which can be moved into the pool */
+bool is_poolable(const GlobalVariable* glob, const SmallPtrSetImpl<GlobalValue*>& g_used) {
+
+	if (!glob->isConstant()
+		|| glob->use_empty()
+		|| glob->isThreadLocal()
+		|| glob->hasSection()
+		|| glob->hasComdat()
+		|| glob->isExternallyInitialized()
+		|| glob->getName().starts_with("llvm.")
+		|| g_used.count(const_cast<GlobalVariable*>(glob))) return false; // llvm.used has to list the global itself
+
+	Type* ty = glob->getValueType();
+
+	if (!isa<ArrayType>(ty) && !isa<StructType>(ty) && !isa<FixedVectorType>(ty)) return false;
+
+	// Would share its offset with the next member, so two distinct globals would compare equal
+	if (glob->getParent()->getDataLayout().getTypeAllocSize(ty).isZero()) return false;
+
+	// Text literals are left to ux-strings
+	auto cdarr_init = dyn_cast<ConstantDataArray>(glob->getInitializer());
+
+	return !cdarr_init || !cdarr_init->isCString();
+
+}
+
+/*
+Packs the selected internal constant aggregates into 'ectx.buf_bytes', each one at an offset aligned
+as the global was. Globals whose image can't be known at compile time are left out.
+*/
+void pack_constant_pool(
+	emit::context& ectx, const selection::selector& sel,
+	std::vector<std::pair<GlobalVariable*, uint64_t>>& members_out, Align& align_out) {
+
+	Module& mod = ectx.mod;
+	const DataLayout& dl = mod.getDataLayout();
+
+	std::vector<GlobalVariable*> g_internals = {};
+	ir_manager::global::get_internals(mod, g_internals);
+
+	SmallVector<GlobalValue*, 8> vec_used = {};
+	collectUsedGlobalVariables(mod, vec_used, false);
+	collectUsedGlobalVariables(mod, vec_used, true);
+
+	SmallPtrSet<GlobalValue*, 8> g_used(vec_used.begin(), vec_used.end());
+
+	auto& buf_pool = ectx.buf_bytes;
+	buf_pool.clear();
+
+	for (GlobalVariable* glob : g_internals) {
+
+		if (!is_poolable(glob, g_used) || !sel.is_selected(glob, selection::kind::POOL)) continue;
+
+		Align align_glob = dl.getPreferredAlign(glob);
+
+		uint64_t offset = alignTo(buf_pool.size(), align_glob);
+		uint64_t sz_glob = dl.getTypeAllocSize(glob->getValueType());
+
+		buf_pool.resize(offset + sz_glob); // zero filled, so padding is zero as well
+
+		if (!write_constant_bytes(dl, glob->getInitializer(),
+			MutableArrayRef<char>(buf_pool).slice(offset, dl.getTypeStoreSize(glob->getValueType())))) {
+
+			buf_pool.resize(offset);
+
+			LOG_OK("Global (" + glob->getName() + ") holds addresses, it's left out of the constant pool.");
+
+			continue;
+
+		}
+
+		members_out.push_back({ glob, offset });
+
+		align_out = std::max(align_out, align_glob);
+
+	}
+
+}
+
+/*
+Creates the constructor decoding 'n_words' words of 'g_pool' in place. Mask of each word is computed from
+its index and a seed rebuilt by an opaque equation, so iterations don't depend on each other and the loop
+is vectorized like a memory copy. Returns the function, and the seed which the host masks the words by.
+*/
+Function* create_pool_decoder(emit::context& ectx, GlobalVariable* g_pool, uint64_t n_words, size_t depth, uint64_t& seed_out) {
+
+	Module& mod = ectx.mod;
+	auto& ctx = mod.getContext();
+	auto& tys = ectx.tys;
+	auto& builder = ectx.builder;
+
+	Function* fn_decoder = Function::Create(
+		FunctionType::get(tys.ty_void, false),
+		GlobalValue::InternalLinkage, "__ux_pool.decode", mod);
+
+	fn_decoder->addFnAttr(Attribute::NoUnwind);
+
+	BasicBlock* bl_entry = BasicBlock::Create(ctx, "entry", fn_decoder);
+	BasicBlock* bl_decode = BasicBlock::Create(ctx, "decode", fn_decoder);
+	BasicBlock* bl_end = BasicBlock::Create(ctx, "end", fn_decoder);
+
+	// Seed is rebuilt once per run, then every mask is derived from it in registers
+
+	math::insval_t insv_eq = math::emit_opaque_equation(ectx, depth);
+
+	// Equations may leave whole bytes of their value zero, a random key spreads the seed over all bits
+	uint64_t val_seed_key = gen_random_int<uint64_t>(0, UINT64_MAX);
+
+	seed_out = insv_eq.second ^ val_seed_key;
+
+	Instruction* v_seed = BinaryOperator::CreateXor(
+		insv_eq.first.back(), ConstantInt::get(tys.ty_i64, val_seed_key), "seed");
+	ectx.append(v_seed);
+
+	ectx.splice_before(BranchInst::Create(bl_decode, bl_entry), "ux-pool");
+
+	/*
+
+	decode:
+
+		%i = phi i64 [ 0, %entry ], [ %i.next, %decode ]
+		%ptr_word = getelementptr i64, ptr @__ux_pool, i64 %i
+		%e_val = load i64, ptr %ptr_word
+
+		%ctr = add i64 %seed, (mul i64 %i, POOL_WEYL_STEP)
+		%mask = ((%ctr ^ (%ctr >> 29)) ^ ((%ctr ^ (%ctr >> 29)) << 17))
+
+		store i64 (xor i64 %e_val, %mask), ptr %ptr_word
+		%i.next = add i64 %i, 1
+		br (icmp ult i64 %i.next, N), label %decode, label %end
+
+	*/
+
+	builder.SetInsertPoint(bl_decode);
+
+	PHINode* v_idx = builder.CreatePHI(tys.ty_i64, 2, "i");
+	v_idx->addIncoming(ConstantInt::get(tys.ty_i64, 0), bl_entry);
+
+	Value* v_ptr_word = builder.CreateInBoundsGEP(tys.ty_i64, g_pool, v_idx, "ptr_word");
+	Value* v_e_val = builder.CreateAlignedLoad(tys.ty_i64, v_ptr_word, Align(8), "e_val");
+
+	Value* v_ctr = builder.CreateAdd(
+		v_seed, builder.CreateMul(v_idx, ConstantInt::get(tys.ty_i64, POOL_WEYL_STEP)), "ctr");
+
+	Value* v_mix = builder.CreateXor(v_ctr, builder.CreateLShr(v_ctr, 29));
+	Value* v_mask = builder.CreateXor(v_mix, builder.CreateShl(v_mix, 17), "mask");
+
+	builder.CreateAlignedStore(builder.CreateXor(v_e_val, v_mask, "d_val"), v_ptr_word, Align(8));
+
+	Value* v_idx_next = builder.CreateNUWAdd(v_idx, ConstantInt::get(tys.ty_i64, 1), "i.next");
+	v_idx->addIncoming(v_idx_next, bl_decode);
+
+	builder.CreateCondBr(
+		builder.CreateICmpULT(v_idx_next, ConstantInt::get(tys.ty_i64, n_words)),
+		bl_decode, bl_end);
+
+	builder.SetInsertPoint(bl_end);
+	builder.CreateRetVoid();
+
+	for (BasicBlock* bl : { bl_decode, bl_end })
+		for (Instruction& inst : *bl)
+			tags::mark(&inst, "ux-pool");
+
+	return fn_decoder;
+
+}
+
+/* Whether the constant used by 'use' may be replaced with a value computed at runtime */
+bool is_hideable_constant(const Use& use) {
+
+	ConstantInt* c_int = dyn_cast<ConstantInt>(use.get());
+
+	if (!c_int) return false;
+
+	unsigned sz_bits = c_int->getBitWidth();
+
+	if (sz_bits != 8 && sz_bits != 16 && sz_bits != 32 && sz_bits != 64) return false;
+
+	Instruction* inst = cast<Instruction>(use.getUser());
+	unsigned idx_op = use.getOperandNo();
+
+	if (auto inst_binop = dyn_cast<BinaryOperator>(inst)) {
+
+		// Division by a constant is strength reduced into a multiplication, by a variable it's tens of cycles
+		switch (inst_binop->getOpcode()) {
+			case Instruction::UDiv: case Instruction::SDiv:
+			case Instruction::URem: case Instruction::SRem: return idx_op == 0;
+			default: return true;
+		}
+
+	}
+
+	if (isa<ICmpInst>(inst) || isa<ReturnInst>(inst)) return true;
+
+	if (isa<SelectInst>(inst)) return idx_op != 0;
+
+	if (isa<StoreInst>(inst)) return idx_op == 0; // stored value, not the address
+
+	// Intrinsics and inline assembly may require immediates even without 'immarg'
+	if (auto inst_call = dyn_cast<CallInst>(inst)) {
+
+		return !isa<IntrinsicInst>(inst_call)
+			&& !inst_call->isInlineAsm()
+			&& inst_call->isArgOperand(&use)
+			&& !inst_call->paramHasAttr(inst_call->getArgOperandNo(&use), Attribute::ImmArg);
+
+	}
+
+	// GEP struct indices, switch cases, PHI incomings, alloca sizes and the rest have to stay constant
+	return false;
+
+}
+
+/*
+Replaces the constants used by 'uses' in 'fn' with roots of a single opaque equation, computed where it
+dominates every user.
+Each constant takes its own root right before its user, truncated to its width and corrected by an
+'add', so hiding N constants costs about one equation and a few instructions per constant instead of N.
+Constants which don't fit the budget of 'fn' are left as they are.
+*/
+void hide_function_constants(
+	emit::context& ectx, budget::tracker& budget, Function& fn, ArrayRef<Use*> uses, const consts_options& opts) {
+
+	std::vector<math::insval_t> roots = {};
+
+	// At most a trunc and the add correcting it around each root
+	size_t n_uses = emit_roots_within_budget(ectx, budget, fn, uses.size(), 2, roots,
+		[&](size_t n_roots, std::vector<math::insval_t>& roots_out) {
+			math::emit_opaque_roots(ectx, opts.depth, n_roots, roots_out);
+		});
+
+	if (n_uses == 0) return;
+
+	std::vector<Instruction*> users = {};
+
+	for (Use* use : uses.take_front(n_uses))
+		users.push_back(cast<Instruction>(use->getUser()));
+
+	ectx.splice_before(get_shared_insertion_point(fn, users), "ux-consts");
+
+	for (size_t i = 0; i < n_uses; ++i) {
+
+		Use* use = uses[i];
+		math::insval_t& root = roots[i];
+
+		ConstantInt* c_int = cast<ConstantInt>(use->get());
+		IntegerType* ty_int = c_int->getType();
+
+		ectx.append(root.first);
+
+		Value* v_root = root.first.back();
+
+		if (ty_int != ectx.tys.ty_i64) {
+
+			Instruction* inst_trunc = new TruncInst(v_root, ty_int);
+			ectx.append(inst_trunc);
+
+			v_root = inst_trunc;
+
+		}
+
+		APInt val_gap = c_int->getValue() - APInt(64, root.second).trunc(ty_int->getBitWidth());
+
+		Instruction* inst_const = BinaryOperator::CreateAdd(v_root, ConstantInt::get(ty_int, val_gap));
+		ectx.append(inst_const);
+
+		ectx.splice_before(cast<Instruction>(use->getUser()), "ux-consts");
+
+		use->set(inst_const);
+
+		NumConstantsHidden++;
+
+	}
+
+}
+
+} // namespace
+
+
+void collect_obf_str_calls(
+    Module& mod, const selection::selector& sel,
+    std::vector<std::pair<CallInst*, GlobalVariable*>>& calls_out) {
+
+	// Discovery starts from _obf_str functions and walks their call sites only once,
+	// so the cost scales with the number of obfuscated strings rather than module size.
+
+	for (Function& fn : mod.functions()) {
+
+		if (fn.getSection() != "._obf_str") continue;
+
+		for (User* fn_user : fn.users()) {
+
+			CallInst* instr_call = dyn_cast<CallInst>(fn_user);
+
+			if (!instr_call || instr_call->getCalledFunction() != &fn) continue;
+
+			if (!sel.is_selected(instr_call->getFunction(), selection::kind::STRINGS)) continue;
+
+			if (GlobalVariable* g_str = get_obf_str_literal(instr_call))
+				calls_out.push_back({ instr_call, g_str });
+
+		}
+
+	}
+
+}
+
+bool obfuscate_string_literals(Module& mod, const selection::selector& sel, const strings_options& opts) {
+
+	emit::context ectx(mod);
+
+	if (opts.mode == strings_mode::STARTUP)
+		return decode_string_literals_at_startup(ectx, sel);
+
+	// Startup decoding doesn't grow the callers, so only the other modes are budgeted
+	budget::tracker budget(selection::kind::STRINGS, "ux-strings");
+
+	// All (call, literal) pairs are collected before any mutation takes place
+
+	std::vector<std::pair<CallInst*, GlobalVariable*>> work_list = {};
+	collect_obf_str_calls(mod, sel, work_list);
+
+	// OP_1: Remove access to the global string on its use with _obf_str function.
+	// OP_2: Remove the global string permanently.
+	// COND_OP_2: Global string shouldn't conflict with standart uses.
+	// For example if there's a _obf_str("hello") and also is a printf("hello")
+	// On that circumstance, we can't remove the global string because it's used on its deobfuscation form as well. 
+
+	/*
+	
+		%str = call _obf_str... [ Convert this line... ]
+
+		to:
+
+		%str = alloca i8, i8 SZ_CDARR
+		
+		%str.bt.1 = alloca i32
+		store i32 CONST, i32* %str.bt.1
+		...
+		%str.bt.<n> = alloca i32
+		store i32 CONST, i32* %str.bt.<n>
+
+		< chain of math operations hidden with opaque predicating >
+
+	*/
+
+	SmallSetVector<GlobalVariable*, 16> g_strings = {};
+
+	for (auto& [instr_call, g_str] : work_list) {
+
+		obfuscate_string_call(ectx, budget, instr_call, g_str, opts);
+
+		g_strings.insert(g_str);
+
+	}
+
+	for (GlobalVariable* g_str : g_strings)
+		erase_literal_if_unused(g_str);
+
+	budget.report();
+
+	return !work_list.empty();
+    
+}
+
+bool obfuscate_references(Module& mod, const selection::selector& sel, const refs_options& opts) {
+
+	emit::context ectx(mod);
+
+	budget::tracker budget(selection::kind::REFS, "ux-refs");
+
+	// Users are collected first, since rewriting a user moves its use out of the global's use list.
+	// They're grouped by function, which emits a single equation for all of its references.
+
+	MapVector<Function*, std::vector<std::pair<Instruction*, GlobalVariable*>>> work_lists = {};
+	SmallSetVector<Instruction*, 16> g_users = {};
+
+	for (auto& glob : mod.globals()) {
+
+		if (opaque::is_opaque_source(&glob)) continue; // loading it through itself gains nothing
+
+		// An instruction using the global twice is listed once, its rewrite replaces both uses
+		for (User* g_user : glob.users()) {
+
+			Instruction* inst_user = dyn_cast<Instruction>(g_user);
+
+			if (!inst_user || !is_reference_rewritable(inst_user, &glob)) continue;
+
+			if (sel.is_selected(inst_user, &glob, selection::kind::REFS))
+				g_users.insert(inst_user);
+
+		}
+
+		for (Instruction* inst_user : g_users)
+			work_lists[inst_user->getFunction()].push_back({ inst_user, &glob });
+
+		g_users.clear();
+
+	}
+
+	for (auto& [fn, work_list] : work_lists)
+		rewrite_function_references(ectx, budget, *fn, work_list, opts);
+
+	budget.report();
+
+	return !work_lists.empty();
+
+}
+
+bool split_blocks(Module& mod, const selection::selector& sel, const split_options& opts) {
+
+	budget::tracker budget(selection::kind::SPLIT, "ux-split");
+
+	bool changed = false;
+
+	for (Function& fn : mod.functions()) {
+
+		if (fn.isDeclaration() || !sel.is_selected(&fn, selection::kind::SPLIT)) continue;
+
+		unsigned short times = get_split_times_within_budget(budget, fn, opts.times);
+
+		if (times == 0) continue;
+
+		SmallPtrSet<Instruction*, 32> terms_before = {};
+		collect_terminators(fn, terms_before);
+
+		for (unsigned short i = 0; i < times; ++i) {
+
+			if (ir_manager::function::split_blocks_once(&fn) != ir_manager::ERR::SUCCESS)
+				break; // no valid block left to split
+
+			changed = true;
+
+		}
+
+		// Every split adds a block and the branch into it
+		budget.charge(fn, fn.size() - terms_before.size());
+
+		mark_new_terminators(fn, terms_before, "ux-split");
+
+	}
+
+	budget.report();
+
+	return changed;
+
+}
+
+bool bogus_control_flow(Module& mod, const selection::selector& sel, const bcf_options& opts) {
+
+	budget::tracker budget(selection::kind::BCF, "ux-bcf");
+
+	bool changed = false;
+
+	for (Function& fn : mod.functions()) {
+
+		if (fn.isDeclaration() || !sel.is_selected(&fn, selection::kind::BCF)) continue;
+
+		unsigned short times = get_split_times_within_budget(budget, fn, opts.times);
+
+		if (times == 0) continue;
+
+		SmallPtrSet<Instruction*, 32> terms_before = {};
+		collect_terminators(fn, terms_before);
+
+		size_t n_ins_before = fn.getInstructionCount();
+
+		changed |= ir_manager::function::bogus_control_flow(&fn, times) == ir_manager::ERR::SUCCESS;
+
+		size_t n_ins_after = fn.getInstructionCount();
+
+		budget.charge(fn, n_ins_after > n_ins_before ? n_ins_after - n_ins_before : 0);
+
+		mark_new_terminators(fn, terms_before, "ux-bcf");
+
+	}
+
+	budget.report();
+
+	return changed;
+
+}
+
+bool canonicalize_pointer_arithmetic(Module& mod, const selection::selector& sel) {
+
+	using namespace PatternMatch;
+
+	const DataLayout& dl = mod.getDataLayout();
+
+	std::vector<IntToPtrInst*> work_list = {};
+
+	for (Function& fn : mod.functions()) {
+
+		if (fn.isDeclaration()) continue;
+
+		if (!sel.is_selected(&fn, selection::kind::STRINGS)
+			&& !sel.is_selected(&fn, selection::kind::REFS)) continue;
+
+		for (Instruction& inst : instructions(fn)) {
+
+			IntToPtrInst* inst_int_to_ptr = dyn_cast<IntToPtrInst>(&inst);
+
+			// Round trips of user code may move the pointer to another object, so their provenance is left alone
+			if (inst_int_to_ptr && !tags::get_mark(inst_int_to_ptr).empty())
+				work_list.push_back(inst_int_to_ptr);
+
+		}
+
+	}
+
+	// Arithmetic may be shared by other round trips, so it's only deleted once every chain is rewritten
+	SmallVector<WeakTrackingVH, 16> insts_dead = {};
+
+	size_t n_rewritten = 0;
+
+	for (IntToPtrInst* inst_int_to_ptr : work_list) {
+
+		Value* v_base = nullptr;
+		Value* v_offset = nullptr;
+		bool is_sub = false;
+
+		Value* v_addr = inst_int_to_ptr->getOperand(0);
+
+		if (match(v_addr, m_c_Add(m_PtrToInt(m_Value(v_base)), m_Value(v_offset)))) is_sub = false;
+		else if (match(v_addr, m_Sub(m_PtrToInt(m_Value(v_base)), m_Value(v_offset)))) is_sub = true;
+		else continue;
+
+		// Integer must hold the whole address and be a valid GEP index, otherwise the round trip truncates it
+		unsigned sz_addr = v_addr->getType()->getScalarSizeInBits();
+
+		if (!v_addr->getType()->isIntegerTy()
+			|| sz_addr != dl.getPointerTypeSizeInBits(v_base->getType())
+			|| sz_addr != dl.getIndexTypeSizeInBits(v_base->getType())
+			|| v_base->getType()->getPointerAddressSpace() != inst_int_to_ptr->getType()->getPointerAddressSpace())
+			continue;
+
+		IRBuilder<> builder(inst_int_to_ptr);
+
+		if (is_sub) v_offset = builder.CreateNeg(v_offset);
+
+		// Not inbounds, the opaque offset may step out of the object before it's brought back
+		Value* v_gep = builder.CreateGEP(builder.getInt8Ty(), v_base, v_offset);
+		Value* v_ptr = builder.CreatePointerCast(v_gep, inst_int_to_ptr->getType()); // no-op with opaque pointers
+
+		// Rewritten chain still belongs to the transform which generated it
+		for (Value* v_new : { v_offset, v_gep, v_ptr }) {
+
+			if (Instruction* inst_new = dyn_cast<Instruction>(v_new))
+				tags::copy_mark(inst_int_to_ptr, inst_new);
+
+		}
+
+		v_ptr->takeName(inst_int_to_ptr);
+
+		inst_int_to_ptr->replaceAllUsesWith(v_ptr);
+		inst_int_to_ptr->eraseFromParent();
+
+		insts_dead.push_back(v_addr);
+
+		n_rewritten++;
+		NumPointerChainsCanonicalized++;
+
+	}
+
+	RecursivelyDeleteTriviallyDeadInstructionsPermissive(insts_dead);
+
+	return n_rewritten > 0;
+
+}
+
+bool rewrite_mba(Module& mod, const selection::selector& sel, const mba_options& opts) {
+
+	std::vector<BinaryOperator*> work_list = {};
+
+	for (Function& fn : mod.functions()) {
+
+		if (fn.isDeclaration() || !sel.is_selected(&fn, selection::kind::MBA)) continue;
+
+		for (Instruction& inst : instructions(fn)) {
+
+			BinaryOperator* inst_binop = dyn_cast<BinaryOperator>(&inst);
+
+			// Generated code is obfuscated already, only user arithmetic is hardened
+			if (!inst_binop || !tags::get_mark(inst_binop).empty() || !mba::is_rewritable(inst_binop)) continue;
+
+			work_list.push_back(inst_binop);
+
+		}
+
+	}
+
+	emit::context ectx(mod);
+
+	budget::tracker budget(selection::kind::MBA, "ux-mba");
+
+	// One opaque zero per function and width, loaded on entry and shared by its rewrites
+	DenseMap<std::pair<Function*, unsigned>, Value*> opaque_zeros;
+
+	auto get_opaque_zero = [&](BinaryOperator* inst_binop) -> Value* {
+
+		Function* fn = inst_binop->getFunction();
+		unsigned sz_bits = inst_binop->getType()->getIntegerBitWidth();
+
+		Value*& v_zero = opaque_zeros[{ fn, sz_bits }];
+
+		if (v_zero) return v_zero;
+
+		Instruction* inst_entry = &*fn->getEntryBlock().getFirstInsertionPt();
+
+		std::vector<Instruction*> insts_opaque = opaque::opaque_by_user_shared_data(ectx, 0, sz_bits);
+
+		ectx.append(insts_opaque);
+
+		if (!budget.try_spend(*fn, insts_opaque.size())) {
+
+			ectx.discard();
+
+			return nullptr;
+
+		}
+
+		ectx.splice_before(inst_entry, "ux-mba");
+
+		v_zero = insts_opaque.back();
+
+		return v_zero;
+
+	};
+
+	bool changed = false;
+
+	for (BinaryOperator* inst_binop : work_list) {
+
+		Function& fn = *inst_binop->getFunction();
+
+		std::vector<Instruction*> insts_mba = {};
+
+		// Every instruction of an identity costs at least a cycle, so a smaller budget is a cheaper rewrite
+		unsigned budget_op = static_cast<unsigned>(std::min<size_t>(opts.budget, budget.remaining(fn)));
+
+		// Cheapest identity plus the opaque operands have to fit, otherwise the load would be wasted
+		Value* v_opaque_zero = budget_op >= 3 + mba::COST_OPAQUE_OPERANDS ? get_opaque_zero(inst_binop) : nullptr;
+
+		if (v_opaque_zero) budget_op = static_cast<unsigned>(std::min<size_t>(budget_op, budget.remaining(fn)));
+
+		if (!mba::rewrite_binop(inst_binop, budget_op, v_opaque_zero, insts_mba)) {
+
+			if (budget_op < opts.budget) budget.skip(fn);
+			else NumMBAOverBudget++;
+
+			continue;
+
+		}
+
+		if (budget_op < opts.budget) budget.downgrade(fn);
+
+		budget.charge(fn, insts_mba.size() - 1); // rewritten instruction is erased
+
+		tags::mark_all(insts_mba, "ux-mba");
+
+		NumMBARewrites++;
+
+		changed = true;
+
+	}
+
+	budget.report();
+
+	return changed;
+
+}
+
+bool encrypt_constant_pool(Module& mod, const selection::selector& sel, const pool_options& opts) {
+
+	emit::context ectx(mod);
+
+	const DataLayout& dl = mod.getDataLayout();
+
+	std::vector<std::pair<GlobalVariable*, uint64_t>> members = {};
+	Align align_pool(8); // decoder works on whole words
+
+	pack_constant_pool(ectx, sel, members, align_pool);
+
+	if (members.empty()) return false;
+
+	auto& buf_pool = ectx.buf_bytes;
+
+	uint64_t n_words = alignTo(buf_pool.size(), 8) / 8;
+	buf_pool.resize(n_words * 8);
+
+	GlobalVariable* g_pool = new GlobalVariable(
+		mod, ArrayType::get(ectx.tys.ty_i8, buf_pool.size()), false /* decoded in place */,
+		GlobalValue::InternalLinkage, nullptr, "__ux_pool");
+
+	g_pool->setAlignment(align_pool);
+
+	uint64_t seed = 0;
+	Function* fn_decoder = create_pool_decoder(ectx, g_pool, n_words, opts.depth, seed);
+
+	// Words are encrypted after the decoder is emitted, since the seed comes from its equation
+
+	for (uint64_t i = 0; i < n_words; ++i) {
+
+		MutableArrayRef<char> buf_word = MutableArrayRef<char>(buf_pool).slice(i * 8, 8);
+
+		uint64_t val_word = read_integer_bytes(dl, buf_word) ^ pool_word_mask(seed, i);
+
+		write_integer_bytes(dl, APInt(64, val_word), buf_word);
+
+	}
+
+	g_pool->setInitializer(ConstantDataArray::get(
+		mod.getContext(), ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(buf_pool.data()), buf_pool.size())));
+
+	// Runs before every constructor of the user, which may read the tables as well
+	appendToGlobalCtors(mod, fn_decoder, 0);
+
+	for (auto& [glob, offset] : members) {
+
+		glob->replaceAllUsesWith(ConstantExpr::getInBoundsGetElementPtr(
+			ectx.tys.ty_i8, g_pool, ConstantInt::get(ectx.tys.ty_i64, offset)));
+
+		glob->eraseFromParent();
+
+		NumPoolGlobals++;
+
+	}
+
+	NumPoolBytes += buf_pool.size();
+
+	return true;
+
+}
+
+bool obfuscate_constants(Module& mod, const selection::selector& sel, const consts_options& opts) {
+
+	emit::context ectx(mod);
+
+	budget::tracker budget(selection::kind::CONSTS, "ux-consts");
+
+	std::vector<Use*> work_list = {};
+
+	bool changed = false;
+
+	for (Function& fn : mod.functions()) {
+
+		if (fn.isDeclaration() || !sel.is_selected(&fn, selection::kind::CONSTS)) continue;
+
+		work_list.clear();
+
+		for (Instruction& inst : instructions(fn)) {
+
+			// Constants of generated code are parts of equations already
+			if (!tags::get_mark(&inst).empty()) continue;
+
+			for (Use& use : inst.operands())
+				if (is_hideable_constant(use)) work_list.push_back(&use);
+
+		}
+
+		if (work_list.empty()) continue;
+
+		hide_function_constants(ectx, budget, fn, work_list, opts);
+
+		changed = true;
+
+	}
+
+	budget.report();
+
+	return changed;
+
+}
+
+}